@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sample_mix.h"
+#include "log.h"
+
+// Mixing kernel microbenchmark: sums N voices into a stereo period and converts it to S16,
+// checks every kernel against the scalar one and reports ns per output frame
+
+#define BENCH_CHANNELS      2
+#define BENCH_SOURCE_FRAMES 65536
+#define BENCH_TIME_NS       200000000ull
+
+static const int bench_voices[] = { 1, 8, 32, 64, 128, 256 };
+static const int bench_periods[] = { 64, 256, 1024 };
+
+static uint64_t bench_now(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void bench_render(const sample_mix_kernel_t* kernel, int* bus, short* out, const short* source,
+                         int voices, int frames, long int* cursor) {
+
+    int v = 0;
+    int count = frames * BENCH_CHANNELS;
+
+    memset(bus, 0, count * sizeof(int));
+
+    for (v=0;v<voices;v++) {
+
+        // spread the voices over the source so they do not all hit the same cache lines
+        long int offset = ((*cursor + v * 977) % (BENCH_SOURCE_FRAMES - frames)) * BENCH_CHANNELS;
+        int gain = SAMPLE_MIX_GAIN_UNITY - (v % 64) * 128;
+
+        if (v & 1) {
+            kernel->mix_mono_stereo(bus, &source[offset], frames, gain);
+        } else {
+            kernel->mix(bus, &source[offset], count, gain);
+        }
+    }
+
+    kernel->convert(out, bus, count);
+    *cursor += frames;
+}
+
+int main(int argc, char* argv[]) {
+
+    int k = 0;
+    int p = 0;
+    int v = 0;
+    int i = 0;
+    unsigned int seed = 1;
+    int max_period = bench_periods[sizeof(bench_periods)/sizeof(bench_periods[0]) - 1];
+
+    short* source = malloc(BENCH_SOURCE_FRAMES * BENCH_CHANNELS * sizeof(short));
+    int* bus = malloc(max_period * BENCH_CHANNELS * sizeof(int));
+    short* out = malloc(max_period * BENCH_CHANNELS * sizeof(short));
+    short* ref = malloc(max_period * BENCH_CHANNELS * sizeof(short));
+
+    if (source == NULL || bus == NULL || out == NULL || ref == NULL) {
+        LOG_ERROR("Mix bench allocation failed\n");
+        return -1;
+    }
+
+    for (i=0;i<BENCH_SOURCE_FRAMES * BENCH_CHANNELS;i++) {
+        source[i] = (short)(rand_r(&seed) & 0xffff);
+    }
+
+    printf("kernel,voices,period,ns_per_frame,frames_per_sec,voice_frames_per_sec,exact\n");
+
+    for (k=0;k<sample_mix_kernel_count();k++) {
+
+        const sample_mix_kernel_t* kernel = sample_mix_kernel_get(k);
+
+        if (!kernel->supported()) {
+            continue;
+        }
+
+        for (v=0;v<(int)(sizeof(bench_voices)/sizeof(bench_voices[0]));v++) {
+
+            for (p=0;p<(int)(sizeof(bench_periods)/sizeof(bench_periods[0]));p++) {
+
+                int voices = bench_voices[v];
+                int frames = bench_periods[p];
+                long int cursor = 0;
+                long int ref_cursor = 0;
+                uint64_t periods = 0;
+
+                // loud random voices saturate, which exercises the conversion as well
+                bench_render(sample_mix_kernel_get(0), bus, ref, source, voices, frames, &ref_cursor);
+                bench_render(kernel, bus, out, source, voices, frames, &cursor);
+                int exact = memcmp(out, ref, frames * BENCH_CHANNELS * sizeof(short)) == 0;
+
+                uint64_t start = bench_now();
+                uint64_t elapsed = 0;
+
+                do {
+                    bench_render(kernel, bus, out, source, voices, frames, &cursor);
+                    periods++;
+                    elapsed = bench_now() - start;
+                } while (elapsed < BENCH_TIME_NS);
+
+                double total_frames = (double)periods * frames;
+
+                printf("%s,%d,%d,%.3f,%.0f,%.0f,%d\n",
+                       kernel->name, voices, frames,
+                       elapsed / total_frames,
+                       total_frames * 1e9 / elapsed,
+                       total_frames * voices * 1e9 / elapsed,
+                       exact);
+            }
+        }
+    }
+
+    free(source);
+    free(bus);
+    free(out);
+    free(ref);
+
+    return 0;
+}
@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "hal_sndfile.h"
+#include "hal_mqueue.h"
+#include "sample_bank.h"
+#include "sample_stats.h"
+#include "sample_trig.h"
+#include "log.h"
+
+// Playback pipeline benchmark: file reads, the control message queue, sample decode and the full
+// trigger to render loop of the engine against the null output, which renders as fast as it can.
+// Writes one CSV row per case to stdout: ns per operation, ns per output frame and frames per second.
+//
+// usage: pipeline-bench [sample dir], the kit defaults to ./samples
+
+#define BENCH_TIME_NS       200000000ull
+#define BENCH_RUN_NS        500000000ull    // engine cases
+#define BENCH_WARMUP_NS     50000000ull
+#define BENCH_TRIG_NS       1000000L        // trigger period of the engine cases
+#define BENCH_RATE          48000
+#define BENCH_CHANNELS      2
+#define BENCH_MQ_NAME       "/pipeline-bench"
+#define BENCH_STATS_NAME    "/pipeline-bench-stats"
+#define BENCH_PATH_MAX      512
+
+// long samples keep every voice busy between two trigger batches, the large kit spreads voices over memory
+#define BENCH_LONG_SAMPLES  4
+#define BENCH_LONG_FRAMES   (10 * BENCH_RATE)
+#define BENCH_KIT_SAMPLES   512
+#define BENCH_KIT_FRAMES    (BENCH_RATE / 4)
+
+static const char* bench_kit[] = {
+    "440.wav", "554.wav", "TR808-BD-01-S16_LE.wav", "TR808-LT-20-S16_LE.wav",
+};
+#define BENCH_KIT_SIZE      (int)(sizeof(bench_kit)/sizeof(bench_kit[0]))
+
+static const int bench_chunks[] = { 256, 1024, 4096 };
+static const int bench_voices[] = { 1, 8, 32, 64, 128, 256 };
+
+static uint64_t bench_now(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void bench_row(const char* stage, const char* name, int voices, uint64_t ops, double frames, uint64_t elapsed) {
+
+    printf("%s,%s,%d,%lu,%.0f,%.3f,%.3f,%.0f\n", stage, name, voices, (unsigned long)ops, frames,
+           ops ? (double)elapsed / ops : 0.0,
+           frames > 0 ? elapsed / frames : 0.0,
+           elapsed ? frames * 1e9 / elapsed : 0.0);
+}
+
+// Streamed reads of a whole file in chunks, rewinding at the end
+static int bench_sndfile_read(const char* path, const char* name) {
+
+    int c = 0;
+    audio_file_t file;
+
+    for (c=0;c<(int)(sizeof(bench_chunks)/sizeof(bench_chunks[0]));c++) {
+
+        char label[128];
+        uint64_t reads = 0;
+        double frames = 0;
+        long int count = 0;
+
+        memset(&file, 0, sizeof(file));
+        if (hal_sndfile_open_stream(&file, (char*)path, bench_chunks[c])) {
+            return -1;
+        }
+
+        uint64_t start = bench_now();
+        uint64_t elapsed = 0;
+
+        do {
+            count = hal_sndfile_read(&file, bench_chunks[c]);
+            if (count <= 0) {
+                hal_sndfile_seek(&file, 0);
+            }
+            // the rewind is not a read, only reads that returned frames are counted
+            if (count > 0) {
+                frames += count;
+                reads++;
+            }
+            elapsed = bench_now() - start;
+        } while (elapsed < BENCH_TIME_NS);
+
+        hal_sndfile_close(&file);
+
+        snprintf(label, sizeof(label), "%s/%d", name, bench_chunks[c]);
+        bench_row("sndfile_read", label, 0, reads, frames, elapsed);
+    }
+
+    return 0;
+}
+
+// Decode and convert to the engine format, as the engine loads a sample without cache: mono
+// samples stay mono, the mixing kernel spreads them over the output channels
+static int bench_decode(const char* path, const char* name) {
+
+    uint64_t loads = 0;
+    double frames = 0;
+    sample_buffer_t buffer;
+
+    uint64_t start = bench_now();
+    uint64_t elapsed = 0;
+
+    do {
+        if (sample_bank_load(&buffer, (char*)path, 0)) {
+
+            LOG_ERROR("Pipeline bench: decode %s failed\n", path);
+            return -1;
+        }
+
+        if (sample_bank_resample(&buffer, BENCH_RATE)
+            || (buffer.channels != 1 && sample_bank_set_channels(&buffer, BENCH_CHANNELS))) {
+
+            LOG_ERROR("Pipeline bench: convert %s failed\n", path);
+            sample_bank_unload(&buffer);
+            return -1;
+        }
+        frames += buffer.num_frames;
+        sample_bank_unload(&buffer);
+        loads++;
+        elapsed = bench_now() - start;
+    } while (elapsed < BENCH_TIME_NS);
+
+    bench_row("decode", name, 0, loads, frames, elapsed);
+
+    return 0;
+}
+
+// Push and pull one control message, the path of every engine command
+static int bench_mqueue(void) {
+
+    mq_t mq;
+    msg_t msg;
+    msg_t pulled;
+    uint64_t trips = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    mq_unlink(BENCH_MQ_NAME);
+    if (hal_mqueue_init(&mq, BENCH_MQ_NAME, NULL) < 0) {
+        return -1;
+    }
+
+    uint64_t start = bench_now();
+    uint64_t elapsed = 0;
+
+    do {
+        hal_mqueue_set_msg_id(&msg, (int)(trips & 0xff));
+        if (hal_mqueue_push(&mq, &msg) < 0 || hal_mqueue_pull(&mq, &pulled, 0) < 0) {
+            LOG_ERROR("Pipeline bench: message round trip failed\n");
+            hal_mqueue_deinit(&mq);
+            return -1;
+        }
+        trips++;
+        elapsed = bench_now() - start;
+    } while (elapsed < BENCH_TIME_NS);
+
+    hal_mqueue_deinit(&mq);
+    bench_row("mqueue", "push_pull", 0, trips, 0, elapsed);
+
+    return 0;
+}
+
+// Engine session on the null output: loads the kit, keeps up to voices playing with random
+// trigger batches and reports the rendered frames. The voices column is the measured average.
+static int bench_engine(const char* name, char** paths, int num_sample, int voices) {
+
+    int i = 0;
+    int ret = 0;
+    unsigned int seed = 1;
+    uint64_t polls = 0;
+    uint64_t triggers = 0;
+    double voice_sum = 0;
+    double kit_frames = 0;
+    sample_stats_t stats;
+    sample_trig_event_t events[SAMPLE_TRIG_BATCH_MAX];
+    struct timespec period = {0, BENCH_TRIG_NS};
+    sample_trig_config_t config = {0};
+    sample_trig_t** list = calloc(num_sample, sizeof(sample_trig_t*));
+
+    if (list == NULL) {
+        LOG_ERROR("Pipeline bench allocation failed\n");
+        return -1;
+    }
+
+    config.output = SAMPLE_OUTPUT_NULL;
+    config.rate = BENCH_RATE;
+    config.max_voices = voices;
+    config.stats_name = BENCH_STATS_NAME;
+
+    uint64_t load_ts = bench_now();
+
+    if (sample_trig_init(list, paths, num_sample, &config)) {
+        free(list);
+        return -1;
+    }
+
+    uint64_t load_elapsed = bench_now() - load_ts;
+
+    for (i=0;i<num_sample;i++) {
+        kit_frames += list[i]->buffer.num_frames;
+    }
+
+    if (sample_stats_open(&stats, BENCH_STATS_NAME)) {
+        sample_trig_exit(list, num_sample);
+        free(list);
+        return -1;
+    }
+
+    uint64_t start = bench_now();
+    uint64_t frame_start = 0;
+    uint64_t measure_ts = 0;
+
+    for (;;) {
+
+        uint64_t now = bench_now();
+
+        if (measure_ts == 0 && now - start >= BENCH_WARMUP_NS) {
+            measure_ts = now;
+            frame_start = sample_trig_frame_clock();
+        }
+
+        if (measure_ts && now - measure_ts >= BENCH_RUN_NS) {
+            break;
+        }
+
+        // a full pool steals the oldest voices, every period starts over with voices playing
+        int left = voices;
+        while (left > 0) {
+
+            int count = (left < SAMPLE_TRIG_BATCH_MAX) ? left : SAMPLE_TRIG_BATCH_MAX;
+
+            for (i=0;i<count;i++) {
+                events[i].id = rand_r(&seed) % num_sample;
+                events[i].velocity = SAMPLE_VELOCITY_MAX;
+                events[i].offset = 0;
+            }
+
+            if (sample_trig_batch(list, events, count) == 0) {
+                triggers += count;
+            }
+            left -= count;
+        }
+
+        nanosleep(&period, NULL);
+
+        if (measure_ts) {
+            voice_sum += atomic_load_explicit(&stats.block->voices_active, memory_order_relaxed);
+            polls++;
+        }
+    }
+
+    uint64_t elapsed = bench_now() - measure_ts;
+    double frames = (double)(sample_trig_frame_clock() - frame_start);
+    int voices_avg = polls ? (int)(voice_sum / polls + 0.5) : 0;
+    char label[128];
+
+    sample_stats_close(&stats);
+    ret = sample_trig_exit(list, num_sample);
+    free(list);
+
+    snprintf(label, sizeof(label), "%s/%d", name, voices);
+    bench_row("kit_load", label, 0, num_sample, kit_frames, load_elapsed);
+    bench_row("engine", label, voices_avg, triggers, frames, elapsed);
+
+    return ret;
+}
+
+// Synthetic kit of count samples of frames each, a decaying noise burst
+static int bench_kit_create(const char* dir, const char* prefix, int count, long int frames, int channels,
+                            int rate, char** paths) {
+
+    int i = 0;
+    long int f = 0;
+    int c = 0;
+    unsigned int seed = 7;
+    audio_file_t file;
+    short* pcm = malloc(frames * channels * sizeof(short));
+
+    if (pcm == NULL) {
+        LOG_ERROR("Pipeline bench allocation failed\n");
+        return -1;
+    }
+
+    for (i=0;i<count;i++) {
+
+        for (f=0;f<frames;f++) {
+
+            int level = 16384 - (int)(f * 16384 / frames);
+
+            for (c=0;c<channels;c++) {
+                pcm[f * channels + c] = (short)((int)(rand_r(&seed) % 65536 - 32768) * level / 32768);
+            }
+        }
+
+        paths[i] = malloc(BENCH_PATH_MAX);
+        if (paths[i] == NULL) {
+            free(pcm);
+            return -1;
+        }
+        snprintf(paths[i], BENCH_PATH_MAX, "%s/%s%04d.wav", dir, prefix, i);
+
+        memset(&file, 0, sizeof(file));
+        if (hal_sndfile_create_wav(&file, paths[i], rate, channels)
+            || hal_sndfile_write(&file, pcm, frames) != frames) {
+
+            LOG_ERROR("Pipeline bench: create %s failed\n", paths[i]);
+            hal_sndfile_close(&file);
+            free(pcm);
+            return -1;
+        }
+        hal_sndfile_close(&file);
+    }
+
+    free(pcm);
+
+    return 0;
+}
+
+static void bench_kit_remove(char** paths, int count) {
+
+    int i = 0;
+
+    for (i=0;i<count;i++) {
+
+        if (paths[i] != NULL) {
+            unlink(paths[i]);
+            free(paths[i]);
+            paths[i] = NULL;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+
+    int i = 0;
+    int v = 0;
+    int ret = 0;
+    const char* sample_dir = (argc > 1) ? argv[1] : "samples";
+    char dir[] = "/tmp/pipeline-bench-XXXXXX";
+    char* kit_paths[BENCH_KIT_SIZE];
+    char* long_paths[BENCH_LONG_SAMPLES] = {NULL};
+    char* large_paths[BENCH_KIT_SAMPLES] = {NULL};
+
+    for (i=0;i<BENCH_KIT_SIZE;i++) {
+
+        kit_paths[i] = malloc(BENCH_PATH_MAX);
+        if (kit_paths[i] == NULL) {
+            LOG_ERROR("Pipeline bench allocation failed\n");
+            return -1;
+        }
+        snprintf(kit_paths[i], BENCH_PATH_MAX, "%s/%s", sample_dir, bench_kit[i]);
+
+        if (access(kit_paths[i], R_OK)) {
+            LOG_ERROR("Pipeline bench: %s not readable, pass the sample directory\n", kit_paths[i]);
+            return -1;
+        }
+    }
+
+    if (mkdtemp(dir) == NULL) {
+        LOG_ERROR("Pipeline bench: temporary directory failed\n");
+        return -1;
+    }
+
+    // long stereo samples at the engine rate play without conversion, the large kit is mono 44.1 kHz
+    if (bench_kit_create(dir, "long", BENCH_LONG_SAMPLES, BENCH_LONG_FRAMES, BENCH_CHANNELS, BENCH_RATE, long_paths)
+        || bench_kit_create(dir, "kit", BENCH_KIT_SAMPLES, BENCH_KIT_FRAMES, 1, 44100, large_paths)) {
+
+        ret = -1;
+        goto out;
+    }
+
+    printf("stage,case,voices,ops,frames,ns_per_op,ns_per_frame,frames_per_sec\n");
+
+    for (i=0;i<BENCH_KIT_SIZE && ret == 0;i++) {
+        ret = bench_sndfile_read(kit_paths[i], bench_kit[i]);
+    }
+
+    for (i=0;i<BENCH_KIT_SIZE && ret == 0;i++) {
+        ret = bench_decode(kit_paths[i], bench_kit[i]);
+    }
+
+    if (ret == 0) {
+        ret = bench_mqueue();
+    }
+
+    for (v=0;v<(int)(sizeof(bench_voices)/sizeof(bench_voices[0])) && ret == 0;v++) {
+        ret = bench_engine("long", long_paths, BENCH_LONG_SAMPLES, bench_voices[v]);
+    }
+
+    if (ret == 0) {
+        ret = bench_engine("samples", kit_paths, BENCH_KIT_SIZE, 64);
+    }
+
+    if (ret == 0) {
+        ret = bench_engine("large_kit", large_paths, BENCH_KIT_SAMPLES, 64);
+    }
+
+out:
+    bench_kit_remove(long_paths, BENCH_LONG_SAMPLES);
+    bench_kit_remove(large_paths, BENCH_KIT_SAMPLES);
+    rmdir(dir);
+
+    for (i=0;i<BENCH_KIT_SIZE;i++) {
+        free(kit_paths[i]);
+    }
+
+    return ret;
+}
@@ -3,29 +3,29 @@
 #include "log.h"
 
 #define SAMPLE_RATE 44100
-#define MIN_PERIOD  8192
+#define DEFAULT_PERIOD  1024
 #define BUFFER_MULT_HEADROOM 2
 
 void alsa_pcm_print_info(pcm_info_t* pcm_info) {
 
-    LOG_INFO( "pcm information\n"
+    LOG_RT_INFO("pcm information\n"
             "   pcm name    : %s\n"
             "   pcm channel : %d\n"
             "   pcm rate    : %d\n"
             "   pcm frames  : %ld\n"
             "   pcm period  : %d\n"
-            "   pcm state   : %s\n"
-            "   pcm handler : %ld\n"
-            "   pcm buffer size : %d\n",
+            "   pcm periods : %d\n"
+            "   pcm buffer size : %d\n"
+            "   pcm access  : %s\n",
 
             pcm_info->name,
             pcm_info->channel,
             pcm_info->rate,
             pcm_info->frames,
             pcm_info->period,
-            pcm_info->current_state,
-            (unsigned long)pcm_info->handler,
-            pcm_info->buffer_size
+            pcm_info->periods,
+            pcm_info->buffer_size,
+            pcm_info->mmap ? "mmap interleaved" : "read/write interleaved"
             );
 }
 
@@ -38,21 +38,21 @@ int alsa_pcm_get_info(snd_pcm_t* pcm_handle, pcm_info_t* pcm_info) {
     pcm_info->name = (char*)snd_pcm_name(pcm_handle);
     if (pcm_info->name == NULL) {
 
-        LOG_ERROR("get pcm info name return null\n");
+        LOG_RT_ERROR("get pcm info name return null\n");
         return -1;
     }
 
     pcm_info->current_state = (char*)snd_pcm_state_name(snd_pcm_state(pcm_handle));
     if (pcm_info->current_state == NULL) {
 
-        LOG_ERROR("get pcm info state return null\n");
+        LOG_RT_ERROR("get pcm info state return null\n");
         return -1;
     }
 
     ret = snd_pcm_hw_params_get_channels(pcm_info->handler, &pcm_val);
     if (ret) {
 
-        LOG_ERROR("get pcm info channel: %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("get pcm info channel: %s\n", snd_strerror(ret));
         return -1;
     }
     pcm_info->channel = pcm_val;
@@ -60,7 +60,7 @@ int alsa_pcm_get_info(snd_pcm_t* pcm_handle, pcm_info_t* pcm_info) {
     ret = snd_pcm_hw_params_get_rate(pcm_info->handler, &pcm_val, NULL);
     if (ret) {
 
-        LOG_ERROR("get pcm info rate: %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("get pcm info rate: %s\n", snd_strerror(ret));
         return -1;
     }
     pcm_info->rate = pcm_val;
@@ -68,7 +68,7 @@ int alsa_pcm_get_info(snd_pcm_t* pcm_handle, pcm_info_t* pcm_info) {
     ret = snd_pcm_hw_params_get_period_size(pcm_info->handler, &pcm_frames, NULL);
     if (ret) {
 
-        LOG_ERROR("get pcm info period size: %s", snd_strerror(ret));
+        LOG_RT_ERROR("get pcm info period size: %s", snd_strerror(ret));
         return -1;
     }
     pcm_info->frames = pcm_frames;
@@ -76,18 +76,26 @@ int alsa_pcm_get_info(snd_pcm_t* pcm_handle, pcm_info_t* pcm_info) {
     ret = snd_pcm_hw_params_get_period_time(pcm_info->handler, &pcm_val, NULL);
     if (ret) {
 
-        LOG_ERROR("get pcm info period: %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("get pcm info period: %s\n", snd_strerror(ret));
         return -1;
     }
     pcm_info->period = pcm_val;
 
-    ret = snd_pcm_hw_params_get_buffer_size(pcm_info->handler, (snd_pcm_uframes_t*)&pcm_val);
+    ret = snd_pcm_hw_params_get_periods(pcm_info->handler, &pcm_val, NULL);
     if (ret) {
 
-        LOG_ERROR("get pcm buffer max size: %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("get pcm info periods: %s\n", snd_strerror(ret));
         return -1;
     }
-    pcm_info->buffer_size = pcm_val;
+    pcm_info->periods = pcm_val;
+
+    ret = snd_pcm_hw_params_get_buffer_size(pcm_info->handler, &pcm_frames);
+    if (ret) {
+
+        LOG_RT_ERROR("get pcm buffer max size: %s\n", snd_strerror(ret));
+        return -1;
+    }
+    pcm_info->buffer_size = pcm_frames;
 
     return 0;
 }
@@ -99,72 +107,87 @@ int alsa_pcm_set_parameters(snd_pcm_t* handle, pcm_info_t* pcm_info) {
     ret = snd_pcm_hw_params_any(handle, pcm_info->handler);
     if (ret < 0) {
 
-        LOG_ERROR("broken configuration for playback: no configurations available: %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("broken configuration for playback: no configurations available: %s\n", snd_strerror(ret));
         return -1;
     }
 
-    ret = snd_pcm_hw_params_set_access(handle, pcm_info->handler, SND_PCM_ACCESS_RW_INTERLEAVED);
+    if (pcm_info->mmap) {
+
+        ret = snd_pcm_hw_params_set_access(handle, pcm_info->handler, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+        if (ret < 0) {
+
+            LOG_RT_WARN("set mmap interleaved mode: %s, falling back to read/write access\n", snd_strerror(ret));
+            pcm_info->mmap = 0;
+        }
+    }
+
+    if (!pcm_info->mmap) {
+        ret = snd_pcm_hw_params_set_access(handle, pcm_info->handler, SND_PCM_ACCESS_RW_INTERLEAVED);
+    }
     if (ret < 0) {
 
-        LOG_ERROR("set interleaved mode: %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("set interleaved mode: %s\n", snd_strerror(ret));
         return -1;
     }
 
     ret = snd_pcm_hw_params_set_format(handle, pcm_info->handler, SND_PCM_FORMAT_S16_LE);
     if (ret < 0) {
 
-        LOG_ERROR("set format: %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("set format: %s\n", snd_strerror(ret));
         return -1;
     }
 
     ret = snd_pcm_hw_params_set_channels(handle, pcm_info->handler, pcm_info->channel);
     if (ret < 0) {
 
-        LOG_ERROR("set channels number: %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("set channels number: %s\n", snd_strerror(ret));
         return -1;
     }
 
-    unsigned int sample_rate = SAMPLE_RATE;
+    unsigned int sample_rate = pcm_info->rate ? pcm_info->rate : SAMPLE_RATE;
     ret = snd_pcm_hw_params_set_rate_near(handle, pcm_info->handler, &sample_rate, 0);
     if (ret < 0) {
 
-        LOG_ERROR("set rate: %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("set rate: %s\n", snd_strerror(ret));
         return -1;
     }
 
-    snd_pcm_uframes_t buffer_size = MIN_PERIOD * pcm_info->channel;
-    ret = snd_pcm_hw_params_set_buffer_size_near(handle, pcm_info->handler, &buffer_size);
+    // nearest size the device accepts, a request of 1 frame selects its smallest period
+    snd_pcm_uframes_t period_size = pcm_info->frames ? pcm_info->frames : DEFAULT_PERIOD;
+    ret = snd_pcm_hw_params_set_period_size_near(handle, pcm_info->handler, &period_size, 0);
     if (ret < 0) {
 
-        LOG_ERROR("set buffer size: %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("set period size: %s\n", snd_strerror(ret));
         return -1;
     }
 
-    snd_pcm_uframes_t period_size = MIN_PERIOD * pcm_info->channel;
-    ret = snd_pcm_hw_params_set_period_size_near(handle, pcm_info->handler, &period_size, 0);
+    unsigned int periods = pcm_info->periods ? pcm_info->periods : BUFFER_MULT_HEADROOM;
+    ret = snd_pcm_hw_params_set_periods_near(handle, pcm_info->handler, &periods, 0);
     if (ret < 0) {
 
-        LOG_ERROR("set buffer size: %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("set periods: %s\n", snd_strerror(ret));
         return -1;
     }
 
     ret = snd_pcm_hw_params(handle, pcm_info->handler);
     if (ret < 0) {
 
-        LOG_ERROR("set hardware parameters. %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("set hardware parameters. %s\n", snd_strerror(ret));
         return -1;
     }
 
     ret = alsa_pcm_get_info(handle, pcm_info);
     if (ret) {
 
-        LOG_ERROR("get pcm info failed\n");
+        LOG_RT_ERROR("get pcm info failed\n");
         return -1;
     }
 
     return 0;
 }
 
+// Also runs on the engine thread when auto-tune reopens the device, so the open path only logs
+// through the real-time macros, which never block a thread with its own log ring
 snd_pcm_t* hal_alsa_pcm_open(char* pcm_device, pcm_info_t* pcm_info) {
 
     int ret = 0;
@@ -175,14 +198,14 @@ snd_pcm_t* hal_alsa_pcm_open(char* pcm_device, pcm_info_t* pcm_info) {
     ret = snd_pcm_open(&pcm_handle, pcm_device, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
     if(ret < 0) {
 
-        LOG_ERROR("open \"%s\" PCM device. %s\n", pcm_device, snd_strerror(ret));
+        LOG_RT_ERROR("open \"%s\" PCM device. %s\n", pcm_device, snd_strerror(ret));
         return NULL;
     }
 
     snd_pcm_hw_params_alloca(&pcm_params);
     if (pcm_params == NULL) {
 
-        LOG_ERROR("allocate pcm parameters");
+        LOG_RT_ERROR("allocate pcm parameters");
         return NULL;
     }
 
@@ -191,11 +214,11 @@ snd_pcm_t* hal_alsa_pcm_open(char* pcm_device, pcm_info_t* pcm_info) {
     ret = alsa_pcm_set_parameters(pcm_handle, pcm_info);
     if (ret < 0) {
 
-        LOG_ERROR("alsa set parameters failed\n");
+        LOG_RT_ERROR("alsa set parameters failed\n");
         return NULL;
     }
 
-    LOG_INFO("pcm open succeeded\n");
+    LOG_RT_INFO("pcm open succeeded\n");
     alsa_pcm_print_info(pcm_info);
 
     return pcm_handle;
@@ -227,11 +250,25 @@ int hal_alsa_get_pcm_frame_avail(snd_pcm_t* pcm_handle) {
     return ret;
 }
 
+// Frames queued ahead of the DAC, i.e. how long a frame written now waits before being heard
+long int hal_alsa_pcm_delay(snd_pcm_t* pcm_handle) {
+
+    snd_pcm_sframes_t delay = 0;
+
+    int ret = snd_pcm_delay(pcm_handle, &delay);
+    if (ret < 0) {
+        LOG_RT_ERROR("get pcm delay: %s\n", snd_strerror(ret));
+        return -1;
+    }
+
+    return delay;
+}
+
 int hal_alsa_pcm_wait(snd_pcm_t* pcm_handle) {
 
     int ret = snd_pcm_wait(pcm_handle, -1);
     if (ret < 0) {
-        LOG_ERROR("wait pcm device: %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("wait pcm device: %s\n", snd_strerror(ret));
         return -1;
     }
 
@@ -247,26 +284,86 @@ int hal_alsa_pcm_close(snd_pcm_t* pcm_handle) {
 }
 
 
+// Returns -EPIPE on over/under run once the device is prepared again, -1 on other errors
 int hal_alsa_pcm_write(snd_pcm_t* pcm_handle, const void *buffer, int frames) {
 
     int ret = 0;
 
     if (pcm_handle == NULL) {
 
-        LOG_ERROR("pcm device handle null\n");
+        LOG_RT_ERROR("pcm device handle null\n");
         return -1;
     }
 
     ret = snd_pcm_writei(pcm_handle, buffer, frames);
     if (ret == -EPIPE) {
 
-        LOG_ERROR("write pcm device: over/under run\n");
+        LOG_RT_ERROR("write pcm device: over/under run\n");
         snd_pcm_prepare(pcm_handle);
+        return -EPIPE;
 
     } else if (ret < 0) {
 
-        LOG_ERROR("write pcm device: %s\n", snd_strerror(ret));
+        LOG_RT_ERROR("write pcm device: %s\n", snd_strerror(ret));
         snd_pcm_recover(pcm_handle, ret, 0);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Contiguous area of the device buffer for up to frames frames, returns the frames available
+// at *buffer or -EPIPE on over/under run once the device is prepared again
+int hal_alsa_pcm_mmap_begin(snd_pcm_t* pcm_handle, void** buffer, snd_pcm_uframes_t* offset, int frames) {
+
+    const snd_pcm_channel_area_t* areas = NULL;
+    snd_pcm_uframes_t frame_count = frames;
+
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm_handle);
+    if (avail < 0) {
+
+        LOG_RT_ERROR("mmap pcm avail: %s\n", snd_strerror(avail));
+        snd_pcm_recover(pcm_handle, avail, 1);
+        return -EPIPE;
+    }
+
+    if ((snd_pcm_uframes_t)avail < frame_count) {
+        frame_count = avail;
+    }
+
+    int ret = snd_pcm_mmap_begin(pcm_handle, &areas, offset, &frame_count);
+    if (ret < 0) {
+
+        LOG_RT_ERROR("mmap pcm begin: %s\n", snd_strerror(ret));
+        snd_pcm_recover(pcm_handle, ret, 1);
+        return -EPIPE;
+    }
+
+    // interleaved access: every channel shares the first area, step is one frame in bits
+    *buffer = (char*)areas[0].addr + (areas[0].first + *offset * areas[0].step) / 8;
+
+    return frame_count;
+}
+
+// Returns -EPIPE on over/under run once the device is prepared again
+int hal_alsa_pcm_mmap_commit(snd_pcm_t* pcm_handle, snd_pcm_uframes_t offset, int frames) {
+
+    snd_pcm_sframes_t ret = snd_pcm_mmap_commit(pcm_handle, offset, frames);
+    if (ret < 0 || ret != frames) {
+
+        LOG_RT_ERROR("mmap pcm commit: over/under run\n");
+        snd_pcm_recover(pcm_handle, ret < 0 ? ret : -EPIPE, 1);
+        return -EPIPE;
+    }
+
+    // no write call starts the stream in mmap mode, start it once the buffer is full
+    if (snd_pcm_state(pcm_handle) == SND_PCM_STATE_PREPARED && snd_pcm_avail_update(pcm_handle) == 0) {
+
+        ret = snd_pcm_start(pcm_handle);
+        if (ret < 0) {
+            LOG_RT_ERROR("start pcm device: %s\n", snd_strerror(ret));
+            return -1;
+        }
     }
 
     return 0;
@@ -11,10 +11,12 @@ typedef struct pcm_info {
     char*                   name;
     unsigned int            channel;
     unsigned int            rate;
-    unsigned long           frames;
+    unsigned long           frames;         // period size, 0 requests the default
     unsigned int            period;
+    unsigned int            periods;        // periods per buffer, 0 requests the default
     char*                   current_state;
     unsigned int            buffer_size;
+    int                     mmap;           // request mmap access, cleared when the device refuses it
 
 } pcm_info_t;
 
@@ -28,11 +30,14 @@ snd_pcm_t* hal_alsa_pcm_open(char* pcm_device, pcm_info_t* pcm_info);
 int hal_alsa_pcm_wait(snd_pcm_t* pcm_handle);
 int hal_alsa_pcm_close(snd_pcm_t* pcm_handle);
 int hal_alsa_pcm_write(snd_pcm_t* pcm_handle, const void *buffer, int frames);
+int hal_alsa_pcm_mmap_begin(snd_pcm_t* pcm_handle, void** buffer, snd_pcm_uframes_t* offset, int frames);
+int hal_alsa_pcm_mmap_commit(snd_pcm_t* pcm_handle, snd_pcm_uframes_t offset, int frames);
 int hal_alsa_pcm_drain_pending_samples(snd_pcm_t* pcm_handle);
 int hal_alsa_pcm_drop_pending_samples(snd_pcm_t* pcm_handle);
 int hal_get_pcm_state_int(snd_pcm_t* pcm_handle);
 char* hal_get_pcm_state_str(snd_pcm_t* pcm_handle);
 
 int hal_alsa_get_pcm_frame_avail(snd_pcm_t* pcm_handle);
+long int hal_alsa_pcm_delay(snd_pcm_t* pcm_handle);
 
 #endif /* HAL_ALSA */
@@ -111,7 +111,7 @@ int hal_mqueue_push(mq_t* mq, msg_t* msg) {
 int hal_mqueue_pull(mq_t* mq, msg_t* msg, int msg_timeout) {
 
     if (msg == NULL) {
-        LOG_ERROR("message pull handle null\n");
+        LOG_RT_ERROR("message pull handle null\n");
         return -1;
     }
 
@@ -125,13 +125,13 @@ int hal_mqueue_pull(mq_t* mq, msg_t* msg, int msg_timeout) {
     if (msg_ret < 0) {
 
         if (errno != ETIMEDOUT && msg_timeout != 0) {
-            LOG_ERROR("Failed to wait message ch%d:id%d-%ld:'%s': %s\n", mq->handle, msg->msg_id, msg->msg_timestamp, mqueu_get_id_string(msg, msg->msg_id), strerror(errno));
+            LOG_RT_ERROR("Failed to wait message ch%d:id%d-%ld:'%s': %s\n", mq->handle, msg->msg_id, msg->msg_timestamp, mqueu_get_id_string(msg, msg->msg_id), strerror(errno));
             msg_ret = -1;
         }
 
     } else if (msg_ret >= 0) {
 
-        LOG_INFO("Message pull ch%d:id%d-%ld:'%s'\n", mq->handle, msg->msg_id, msg->msg_timestamp, mqueu_get_id_string(msg, msg->msg_id));
+        LOG_RT_INFO("Message pull ch%d:id%d-%ld:'%s'\n", mq->handle, msg->msg_id, msg->msg_timestamp, mqueu_get_id_string(msg, msg->msg_id));
     }
 
     if (msg_ret == -1) {
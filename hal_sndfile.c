@@ -44,9 +44,12 @@ int hal_sndfile_open(audio_file_t* audio_file, char* file_path) {
         return -1;
     }
 
-    audio_file->buffer = malloc(audio_file->info.frames * audio_file->info.channels);
-    if (audio_file->buffer == NULL) {
-        LOG_ERROR("Allocate audio buffer: %s\n", strerror(errno));
+    size_t buffer_size = audio_file->info.frames * audio_file->info.channels * sizeof(short);
+
+    int ret = posix_memalign((void**)&audio_file->buffer, HAL_SNDFILE_BUFFER_ALIGN, buffer_size);
+    if (ret) {
+        LOG_ERROR("Allocate audio buffer: %s\n", strerror(ret));
+        audio_file->buffer = NULL;
         return -1;
     }
 
@@ -59,17 +62,47 @@ int hal_sndfile_open(audio_file_t* audio_file, char* file_path) {
     return 0;
 }
 
+// Open for chunked reads: the buffer holds buffer_frames frames, 0 leaves it to the caller
+int hal_sndfile_open_stream(audio_file_t* audio_file, char* file_path, sf_count_t buffer_frames) {
+
+    audio_file->handler = sf_open(file_path, SFM_READ, &audio_file->info);
+    if (audio_file->handler == NULL) {
+        LOG_ERROR("Open audio file %s: %s\n", file_path, sf_strerror(NULL));
+        return -1;
+    }
+
+    if (buffer_frames > 0) {
+
+        size_t buffer_size = buffer_frames * audio_file->info.channels * sizeof(short);
+
+        int ret = posix_memalign((void**)&audio_file->buffer, HAL_SNDFILE_BUFFER_ALIGN, buffer_size);
+        if (ret) {
+            LOG_ERROR("Allocate audio buffer: %s\n", strerror(ret));
+            audio_file->buffer = NULL;
+            return -1;
+        }
+    }
+
+    audio_file->path = strdup(file_path);
+
+    return 0;
+}
+
 int hal_sndfile_close(audio_file_t* audio_file) {
 
     int ret = 0;
 
-    if (sf_close(audio_file->handler)) {
+    if (audio_file->handler != NULL && sf_close(audio_file->handler)) {
 
         LOG_ERROR("Audio file close failure\n");
         ret = -1;
     }
+    audio_file->handler = NULL;
 
     free(audio_file->buffer);
+    free(audio_file->path);
+    audio_file->buffer = NULL;
+    audio_file->path = NULL;
 
     return ret;
 }
@@ -101,6 +134,17 @@ int hal_sndfile_reset_buff_ptr(audio_file_t* audio_file) {
     return 0;
 }
 
+int hal_sndfile_seek(audio_file_t* audio_file, sf_count_t frame) {
+
+    if (sf_seek(audio_file->handler, frame, SF_SEEK_SET) < 0) {
+
+        LOG_ERROR("Audio file %s seek to frame %ld failure\n", audio_file->path, (long int)frame);
+        return -1;
+    }
+
+    return 0;
+}
+
 int hal_sndfile_check_wav_s16_format(audio_file_t* audio_file) {
 
     if (audio_file->info.format != (SF_FORMAT_WAV | SF_FORMAT_PCM_16)) {
@@ -111,3 +155,45 @@ int hal_sndfile_check_wav_s16_format(audio_file_t* audio_file) {
 
     return 0;
 }
+
+// Clip out of range float samples instead of wrapping them when read as short
+int hal_sndfile_set_clipping(audio_file_t* audio_file) {
+
+    if (sf_command(audio_file->handler, SFC_SET_CLIPPING, NULL, SF_TRUE) != SF_TRUE) {
+
+        LOG_WARN("Audio file %s: clipping not supported\n", audio_file->path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int hal_sndfile_create_wav(audio_file_t* audio_file, char* file_path, int rate, int channels) {
+
+    memset(audio_file, 0, sizeof(audio_file_t));
+
+    audio_file->info.samplerate = rate;
+    audio_file->info.channels = channels;
+    audio_file->info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+
+    audio_file->handler = sf_open(file_path, SFM_WRITE, &audio_file->info);
+    if (audio_file->handler == NULL) {
+        LOG_ERROR("Create audio file %s: %s\n", file_path, sf_strerror(NULL));
+        return -1;
+    }
+
+    audio_file->path = strdup(file_path);
+
+    return 0;
+}
+
+long int hal_sndfile_write(audio_file_t* audio_file, const short* buffer, sf_count_t num_frames) {
+
+    sf_count_t frame_count = sf_writef_short(audio_file->handler, buffer, num_frames);
+    if (frame_count != num_frames) {
+        LOG_RT_ERROR("Audio file write: %s\n", sf_strerror(audio_file->handler));
+        return -1;
+    }
+
+    return frame_count;
+}
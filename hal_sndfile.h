@@ -3,6 +3,8 @@
 
 #include <sndfile.h>
 
+#define HAL_SNDFILE_BUFFER_ALIGN 64
+
 typedef enum audio_file_event {
     last_frame_event=1,
 
@@ -21,9 +23,14 @@ void hal_sndfile_print_info(audio_file_t* audio_file);
 void hal_sndfile_set_notification_callback(void* cb_fct);
 
 int hal_sndfile_open(audio_file_t* audio_file, char* file_path);
+int hal_sndfile_open_stream(audio_file_t* audio_file, char* file_path, sf_count_t buffer_frames);
 int hal_sndfile_close(audio_file_t* audio_file);
 long int hal_sndfile_read(audio_file_t* audio_file, sf_count_t num_frames);
 int hal_sndfile_reset_buff_ptr(audio_file_t* audio_file);
+int hal_sndfile_seek(audio_file_t* audio_file, sf_count_t frame);
 int hal_sndfile_check_wav_s16_format(audio_file_t* audio_file);
+int hal_sndfile_set_clipping(audio_file_t* audio_file);
+int hal_sndfile_create_wav(audio_file_t* audio_file, char* file_path, int rate, int channels);
+long int hal_sndfile_write(audio_file_t* audio_file, const short* buffer, sf_count_t num_frames);
 
 #endif /* HAL_SNDFILE */
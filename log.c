@@ -1,4 +1,14 @@
 #include <time.h> // time_t, tm, time, localtime, strftime
+#include <stdlib.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "log.h"
+
+#define LOG_RT_RING_SIZE    1024    // records per thread, power of two
+#define LOG_RT_MAX_THREADS  16
+#define LOG_RT_LINE_MAX     1024
+#define LOG_RT_POLL_NS      5000000
 
 // Returns the local date/time formatted as 2014-03-19 11:11:52
 char* getFormattedTime(void)
@@ -24,3 +34,342 @@ float getClockTime(void) {
 
     return (float)(t/(float)CLOCKS_PER_SEC);
 }
+
+// Asynchronous logging
+
+typedef struct log_record {
+
+    uint64_t        timestamp;
+    const char*     format;
+    const char*     file;
+    const char*     func;
+    int             line;
+    int             level;
+    int             num_args;
+    log_arg_t       arg[LOG_RT_MAX_ARGS];
+
+} log_record_t;
+
+// Single producer (the registered thread) single consumer (the log thread) ring
+typedef struct log_ring {
+
+    log_record_t    record[LOG_RT_RING_SIZE];
+    const char*     name;
+    unsigned long   dropped_reported;
+
+    _Alignas(64) atomic_size_t  head;
+    _Alignas(64) atomic_size_t  tail;
+    atomic_ulong                dropped;
+
+} log_ring_t;
+
+static const char* log_level_str[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+static __thread log_ring_t* log_thread_ring = NULL;
+static log_ring_t* log_rings[LOG_RT_MAX_THREADS];
+static atomic_int log_num_rings;
+static atomic_int log_running;
+static pthread_t log_tid;
+static pthread_mutex_t log_register_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct timespec log_start_realtime;
+static uint64_t log_start_monotonic;
+
+static uint64_t log_monotonic(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Format a record with the printf conversions of its format string, one stored argument per conversion
+static int log_format_record(char* line, size_t size, const log_record_t* record) {
+
+    size_t len = 0;
+    int num_arg = 0;
+    char spec[32];
+    const char* fmt = record->format;
+    const char* file = strrchr(record->file, '/') ? strrchr(record->file, '/') + 1 : record->file;
+
+    // wall clock of the record from the monotonic offset since the log thread started
+    uint64_t elapsed = record->timestamp - log_start_monotonic;
+    time_t seconds = log_start_realtime.tv_sec + (log_start_realtime.tv_nsec + elapsed) / 1000000000ull;
+    struct tm timeinfo;
+    char date[20];
+
+    localtime_r(&seconds, &timeinfo);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &timeinfo);
+
+    len = snprintf(line, size, "%s %f %-5s[%s][%s:%d] ", date, elapsed / 1e9,
+                   log_level_str[record->level], file, record->func, record->line);
+
+    while (*fmt != '\0' && len < size - 1) {
+
+        if (*fmt != '%') {
+            line[len++] = *fmt++;
+            continue;
+        }
+
+        if (fmt[1] == '%') {
+            line[len++] = '%';
+            fmt += 2;
+            continue;
+        }
+
+        const char* start = fmt++;
+        int longs = 0;
+        int size_t_arg = 0;
+
+        while (*fmt != '\0' && strchr("-+ #0", *fmt)) {
+            fmt++;
+        }
+        while (isdigit((unsigned char)*fmt) || *fmt == '.') {
+            fmt++;
+        }
+        while (*fmt != '\0' && strchr("hlzjt", *fmt)) {
+            longs += (*fmt == 'l');
+            size_t_arg |= (*fmt == 'z' || *fmt == 'j' || *fmt == 't');
+            fmt++;
+        }
+
+        char conversion = *fmt;
+        if (conversion == '\0' || (size_t)(fmt - start + 2) > sizeof(spec)) {
+            break;
+        }
+        fmt++;
+
+        memcpy(spec, start, fmt - start);
+        spec[fmt - start] = '\0';
+
+        if (num_arg >= record->num_args) {
+            len += snprintf(&line[len], size - len, "(missing)");
+            continue;
+        }
+
+        log_arg_t arg = record->arg[num_arg++];
+        int ret = 0;
+
+        switch (conversion) {
+
+            case 'd': case 'i':
+                if (size_t_arg || longs > 1) {
+                    ret = snprintf(&line[len], size - len, spec, (long long)arg.i);
+                } else if (longs == 1) {
+                    ret = snprintf(&line[len], size - len, spec, (long)arg.i);
+                } else {
+                    ret = snprintf(&line[len], size - len, spec, (int)arg.i);
+                }
+                break;
+
+            case 'u': case 'x': case 'X': case 'o':
+                if (size_t_arg || longs > 1) {
+                    ret = snprintf(&line[len], size - len, spec, (unsigned long long)arg.i);
+                } else if (longs == 1) {
+                    ret = snprintf(&line[len], size - len, spec, (unsigned long)arg.i);
+                } else {
+                    ret = snprintf(&line[len], size - len, spec, (unsigned int)arg.i);
+                }
+                break;
+
+            case 'c':
+                ret = snprintf(&line[len], size - len, spec, (int)arg.i);
+                break;
+
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                ret = snprintf(&line[len], size - len, spec, arg.d);
+                break;
+
+            case 's':
+                ret = snprintf(&line[len], size - len, spec, arg.p ? (const char*)arg.p : "(null)");
+                break;
+
+            case 'p':
+                ret = snprintf(&line[len], size - len, spec, arg.p);
+                break;
+
+            default:
+                ret = snprintf(&line[len], size - len, "%s", spec);
+                break;
+        }
+
+        if (ret > 0) {
+            len += ret;
+        }
+    }
+
+    if (len >= size) {
+        len = size - 1;
+    }
+    line[len] = '\0';
+
+    return len;
+}
+
+void log_rt_push(int level, const char* format, const char* file, const char* func, int line, int num_args, const log_arg_t* arg) {
+
+    log_ring_t* ring = log_thread_ring;
+    log_record_t* record = NULL;
+    log_record_t local;
+
+    // threads without a ring are allowed to block, format in place
+    if (ring == NULL) {
+        record = &local;
+    } else {
+
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        if (head - tail >= LOG_RT_RING_SIZE) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return;
+        }
+        record = &ring->record[head & (LOG_RT_RING_SIZE - 1)];
+    }
+
+    record->timestamp = log_monotonic();
+    record->format = format;
+    record->file = file;
+    record->func = func;
+    record->line = line;
+    record->level = level;
+    record->num_args = num_args;
+    memcpy(record->arg, arg, num_args * sizeof(log_arg_t));
+
+    if (ring == NULL) {
+
+        char text[LOG_RT_LINE_MAX];
+
+        if (log_start_monotonic == 0) {
+            clock_gettime(CLOCK_REALTIME, &log_start_realtime);
+            log_start_monotonic = log_monotonic();
+        }
+        log_format_record(text, sizeof(text), record);
+        fputs(text, stdout);
+        return;
+    }
+
+    atomic_store_explicit(&ring->head, atomic_load_explicit(&ring->head, memory_order_relaxed) + 1, memory_order_release);
+}
+
+// Give the calling thread its own ring, called once from the thread before its real-time loop
+int log_rt_register(const char* name) {
+
+    if (!atomic_load(&log_running) || log_thread_ring != NULL) {
+        return -1;
+    }
+
+    log_ring_t* ring = calloc(1, sizeof(log_ring_t));
+    if (ring == NULL) {
+        return -1;
+    }
+    ring->name = name;
+
+    pthread_mutex_lock(&log_register_lock);
+
+    int index = atomic_load(&log_num_rings);
+    if (index >= LOG_RT_MAX_THREADS) {
+
+        pthread_mutex_unlock(&log_register_lock);
+        free(ring);
+        return -1;
+    }
+
+    log_rings[index] = ring;
+    atomic_store(&log_num_rings, index + 1);
+
+    pthread_mutex_unlock(&log_register_lock);
+
+    log_thread_ring = ring;
+
+    return 0;
+}
+
+static int log_drain(void) {
+
+    int i = 0;
+    int count = 0;
+    char text[LOG_RT_LINE_MAX];
+    int num_rings = atomic_load(&log_num_rings);
+
+    for (i=0;i<num_rings;i++) {
+
+        log_ring_t* ring = log_rings[i];
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        for (;tail!=head;tail++) {
+
+            log_format_record(text, sizeof(text), &ring->record[tail & (LOG_RT_RING_SIZE - 1)]);
+            fputs(text, stdout);
+            atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+            count++;
+        }
+
+        unsigned long dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        if (dropped != ring->dropped_reported) {
+
+            LOG_WARN("Log ring %s full, %lu records dropped\n", ring->name, dropped - ring->dropped_reported);
+            ring->dropped_reported = dropped;
+        }
+    }
+
+    if (count) {
+        fflush(stdout);
+    }
+
+    return count;
+}
+
+static void* log_thread(void* arg) {
+
+    struct timespec poll = { .tv_sec = 0, .tv_nsec = LOG_RT_POLL_NS };
+
+    // producers never signal, the rings are polled so that logging costs no syscall
+    while (atomic_load(&log_running)) {
+
+        if (log_drain() == 0) {
+            nanosleep(&poll, NULL);
+        }
+    }
+
+    log_drain();
+
+    return NULL;
+}
+
+int log_async_start(void) {
+
+    clock_gettime(CLOCK_REALTIME, &log_start_realtime);
+    log_start_monotonic = log_monotonic();
+
+    atomic_store(&log_running, 1);
+
+    if (pthread_create(&log_tid, NULL, log_thread, NULL)) {
+
+        atomic_store(&log_running, 0);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Flush every ring and release them, registered threads must have exited
+void log_async_stop(void) {
+
+    int i = 0;
+
+    if (!atomic_load(&log_running)) {
+        return;
+    }
+
+    atomic_store(&log_running, 0);
+    pthread_join(log_tid, NULL);
+
+    for (i=0;i<atomic_load(&log_num_rings);i++) {
+
+        free(log_rings[i]);
+        log_rings[i] = NULL;
+    }
+    atomic_store(&log_num_rings, 0);
+}
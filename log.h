@@ -1,5 +1,9 @@
+#ifndef LOG_H
+#define LOG_H
+
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 // Returns the local date/time formatted as 2014-03-19 11:11:52
 
 char* getFormattedTime(void);
@@ -9,12 +13,99 @@ float getClockTime(void);
 
 #define __SHORT_FILE__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 
+// Compile time level filtering, e.g. make CFLAGS+=-DLOG_LEVEL=LOG_LEVEL_WARN
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE  4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
 // Main log macro
 
 #define __LOG__(format, loglevel, ...) printf("%s %f %-5s[%s][%s:%d] " format, getFormattedTime(), getClockTime(), loglevel, __SHORT_FILE__, __func__ , __LINE__, ## __VA_ARGS__)
 
+// Filtered out levels cost nothing but still type check their arguments
+#define __LOG_DISABLED__(format, ...) do { if (0) printf(format, ## __VA_ARGS__); } while (0)
+
+// Real-time log macro: arguments are stored raw in a per-thread ring and formatted by the log thread.
+// Up to LOG_RT_MAX_ARGS integer, floating point or pointer arguments, %s strings must outlive the record.
+
+#define LOG_RT_MAX_ARGS 8
+
+typedef union log_arg {
+    int64_t     i;
+    double      d;
+    const void* p;
+} log_arg_t;
+
+static inline log_arg_t log_arg_int(int64_t value) { log_arg_t arg = { .i = value }; return arg; }
+static inline log_arg_t log_arg_double(double value) { log_arg_t arg = { .d = value }; return arg; }
+static inline log_arg_t log_arg_ptr(const void* value) { log_arg_t arg = { .p = value }; return arg; }
+
+#define LOG_ARG(x) _Generic((x), \
+    float: log_arg_double, double: log_arg_double, \
+    char*: log_arg_ptr, const char*: log_arg_ptr, void*: log_arg_ptr, const void*: log_arg_ptr, \
+    default: log_arg_int)(x)
+
+#define LOG_NARGS(...) LOG_NARGS_(0, ## __VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+
+#define LOG_MAP_0()
+#define LOG_MAP_1(a)                        LOG_ARG(a)
+#define LOG_MAP_2(a, b)                     LOG_ARG(a), LOG_ARG(b)
+#define LOG_MAP_3(a, b, c)                  LOG_MAP_2(a, b), LOG_ARG(c)
+#define LOG_MAP_4(a, b, c, d)               LOG_MAP_3(a, b, c), LOG_ARG(d)
+#define LOG_MAP_5(a, b, c, d, e)            LOG_MAP_4(a, b, c, d), LOG_ARG(e)
+#define LOG_MAP_6(a, b, c, d, e, f)         LOG_MAP_5(a, b, c, d, e), LOG_ARG(f)
+#define LOG_MAP_7(a, b, c, d, e, f, g)      LOG_MAP_6(a, b, c, d, e, f), LOG_ARG(g)
+#define LOG_MAP_8(a, b, c, d, e, f, g, h)   LOG_MAP_7(a, b, c, d, e, f, g), LOG_ARG(h)
+#define LOG_MAP_(n, ...) LOG_MAP_##n(__VA_ARGS__)
+#define LOG_MAP(n, ...) LOG_MAP_(n, __VA_ARGS__)
+
+#define __LOG_RT__(format, loglevel, ...) log_rt_push(loglevel, format, __FILE__, __func__, __LINE__, LOG_NARGS(__VA_ARGS__), \
+    (const log_arg_t[LOG_RT_MAX_ARGS]){ LOG_MAP(LOG_NARGS(__VA_ARGS__), ## __VA_ARGS__) })
+
+void log_rt_push(int level, const char* format, const char* file, const char* func, int line, int num_args, const log_arg_t* arg);
+int log_rt_register(const char* name);
+int log_async_start(void);
+void log_async_stop(void);
+
 // Specific log macros with
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
 #define LOG_DEBUG(format, ...) __LOG__(format, "DEBUG", ## __VA_ARGS__)
+#define LOG_RT_DEBUG(format, ...) __LOG_RT__(format, LOG_LEVEL_DEBUG, ## __VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...) __LOG_DISABLED__(format, ## __VA_ARGS__)
+#define LOG_RT_DEBUG(format, ...) __LOG_DISABLED__(format, ## __VA_ARGS__)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(format, ...) __LOG__(format, "INFO", ## __VA_ARGS__)
+#define LOG_RT_INFO(format, ...) __LOG_RT__(format, LOG_LEVEL_INFO, ## __VA_ARGS__)
+#else
+#define LOG_INFO(format, ...) __LOG_DISABLED__(format, ## __VA_ARGS__)
+#define LOG_RT_INFO(format, ...) __LOG_DISABLED__(format, ## __VA_ARGS__)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
 #define LOG_WARN(format, ...) __LOG__(format, "WARN", ## __VA_ARGS__)
+#define LOG_RT_WARN(format, ...) __LOG_RT__(format, LOG_LEVEL_WARN, ## __VA_ARGS__)
+#else
+#define LOG_WARN(format, ...) __LOG_DISABLED__(format, ## __VA_ARGS__)
+#define LOG_RT_WARN(format, ...) __LOG_DISABLED__(format, ## __VA_ARGS__)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
 #define LOG_ERROR(format, ...) __LOG__(format, "ERROR", ## __VA_ARGS__)
-#define LOG_INFO(format, ...) __LOG__(format, "INFO", ## __VA_ARGS__)
+#define LOG_RT_ERROR(format, ...) __LOG_RT__(format, LOG_LEVEL_ERROR, ## __VA_ARGS__)
+#else
+#define LOG_ERROR(format, ...) __LOG_DISABLED__(format, ## __VA_ARGS__)
+#define LOG_RT_ERROR(format, ...) __LOG_DISABLED__(format, ## __VA_ARGS__)
+#endif
+
+#endif /* LOG_H */
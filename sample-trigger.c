@@ -1,120 +1,542 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
 
 #include "sample_trig.h"
+#include "sample_kit.h"
+#include "sample_input.h"
 #include "log.h"
 
-enum key_code {
-    key_trig_0 = 'q',
-    key_trig_1 = 's',
-    key_trig_2 = 'd',
-    key_trig_3 = 'f',
-    key_trig_4 = 'g',
-    key_trig_5 = 'h',
-    key_trig_exit   = 'x',
-};
+// Keys of the samples given on the command line, in order
+#define KEY_TRIG_DEFAULT    "qsdfgh"
+#define KEY_TRIG_EXIT       SAMPLE_KIT_KEY_EXIT
+
+// MIDI notes of the samples given on the command line, from the General MIDI bass drum up
+#define MIDI_NOTE_DEFAULT   36
+
+#define INPUT_SOURCE_MAX    16
+#define INPUT_MIDI_BATCH    SAMPLE_TRIG_BATCH_MAX   // note-ons of one read go out as one trigger batch
+
+typedef struct key_ctx {
+    sample_kit_t*   kit;
+    int             exited;
+    uint64_t        notes;
+    uint64_t        dropped;        // triggers refused by a full trigger queue
+
+} key_ctx_t;
+
+#define LATENCY_INTERVAL_MIN_US 1000
+#define LATENCY_INTERVAL_MAX_US 20000
+
+
+static void usage(char* name) {
+
+    LOG_ERROR("Usage: %s [options] [<path sample 1> <path sample 2> ...]\n"
+              "  -K  <file> load the samples of a kit file, one \"<name> <path> [<key>]\" per line\n"
+              "  -m  memory map canonical WAV S16_LE samples instead of decoding them\n"
+              "  -p  prefault memory mapped samples at load time\n"
+              "  -o  <backend>[:<target>] output to alsa[:<pcm device>], null or wav[:<file>]\n"
+              "  -v  <count> maximum number of voices playing at once\n"
+              "  -n  <count> maximum number of voices per sample\n"
+              "  -s  <oldest|quietest|same> voice stealing policy when all voices play\n"
+              "  -k  <scalar|sse2|avx2> force the mixing kernel\n"
+              "  -r  <rate> output rate in Hz\n"
+              "  -f  <frames> period size in frames\n"
+              "  -c  <count> periods per buffer\n"
+              "  -a  auto-tune the period: start at the device minimum and back off on xruns\n"
+              "  -M  mmap the pcm device buffer and render straight into it\n"
+              "  -R  <priority> real-time audio thread: SCHED_FIFO priority, locked and prefaulted memory\n"
+              "  -C  <cpus> pin the real-time audio thread to a cpu list such as 2 or 2-3\n"
+              "  -d  <dir> cache samples converted to the output format in <dir> and map them on the next start\n"
+              "  -S  <MiB>[:<head ms>[:<read-ahead ms>]] stream samples decoding to more than <MiB> from disk\n"
+              "  -I  <fifo:<path>|unix:<path>|tcp:[<address>:]<port>> read trigger keys from another source as well as stdin\n"
+              "  -I  midi:<path|-> read MIDI note-ons from a raw MIDI device, a fifo or stdin\n"
+              "  -Q  <name> accept triggers from other processes through the shared memory ring <name> (e.g. /sample-trig)\n"
+              "  -P  <name> publish runtime metrics in the shared memory stats block <name> (e.g. /sample-trig-stats)\n"
+              "  -W  <name> print the stats block of a running engine every second until it exits\n"
+              "  -j  <file> record every trigger with its start frame and time to <file>\n"
+              "  -J  <file> replay a recorded session into the null or wav output as fast as possible and print the output hash\n"
+              "  -T  <file> replay a MIDI byte dump at full speed and report the parser throughput\n"
+              "  -l  <count> fire <count> scripted triggers and report the trigger to output latency\n",
+              name);
+}
 
+// Note-ons are parsed in batches and triggered with their velocity, unmapped notes are ignored
+static void midi_dispatch(key_ctx_t* key_ctx, sample_midi_parser_t* parser, const unsigned char* bytes, int count) {
+
+    int i = 0;
+    int used = 0;
+    int num_note = 0;
+    int num_event = 0;
+    sample_midi_note_t notes[INPUT_MIDI_BATCH];
+    sample_trig_event_t events[INPUT_MIDI_BATCH];
+    sample_kit_t* kit = key_ctx->kit;
+
+    while (count > 0) {
+
+        num_note = sample_midi_parse(parser, bytes, count, &used, notes, INPUT_MIDI_BATCH);
+        bytes += used;
+        count -= used;
+
+        // notes of one read, such as a chord, start together in the same period
+        num_event = 0;
+        for (i=0;i<num_note;i++) {
+
+            int id = sample_kit_note(kit, notes[i].note);
+            if (id >= 0) {
+                events[num_event].id = id;
+                events[num_event].velocity = notes[i].velocity;
+                events[num_event].offset = 0;
+                num_event++;
+            }
+        }
 
-int main(int argc, char* argv[]) {
+        if (num_event > 0 && sample_trig_batch(kit->sample, events, num_event)) {
+            key_ctx->dropped += num_event;
+        }
+        key_ctx->notes += num_note;
+    }
+}
 
-    int num_sample_trig = 0;
-    sample_trig_t* sample_list[samples_max] = {0};
+// Every byte of a key source is a key, keys without a sample are ignored
+static int key_dispatch(void* ctx, sample_input_source_t* source, const unsigned char* keys, int count) {
 
+    int i = 0;
+    key_ctx_t* key_ctx = (key_ctx_t*)ctx;
+    sample_kit_t* kit = key_ctx->kit;
 
-    LOG_INFO("Start of %s\n", argv[0]);
+    if (source->type == SAMPLE_INPUT_MIDI) {
+        midi_dispatch(key_ctx, &source->midi, keys, count);
+        return 0;
+    }
+
+    for (i=0;i<count;i++) {
+
+        if (keys[i] == KEY_TRIG_EXIT) {
+
+            if (sample_trig_exit(kit->sample, kit->num_sample) == 0) {
+                key_ctx->exited = 1;
+                return 1;
+            }
+            continue;
+        }
+
+        int id = sample_kit_key(kit, keys[i]);
+        if (id >= 0) {
+            LOG_DEBUG("Key trig: %c\n", keys[i]);
+            sample_trig(kit->sample, id);
+        }
+    }
+
+    return 0;
+}
 
-    if (argv[1] == NULL) {
-        LOG_ERROR("Usage: %s <path sample 1> <path sample 2> ...\n", argv[0]);
+// Replay a recorded MIDI byte dump: parser alone for a second, then once through the trigger path
+static int midi_dump_test(const char* path, key_ctx_t* key_ctx) {
+
+    long int size = 0;
+    uint64_t bytes = 0;
+    uint64_t notes = 0;
+    uint64_t start = 0;
+    uint64_t elapsed = 0;
+    unsigned char* dump = NULL;
+    sample_midi_note_t note[INPUT_MIDI_BATCH];
+    sample_midi_parser_t parser;
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL || fseek(file, 0, SEEK_END) || (size = ftell(file)) <= 0 || fseek(file, 0, SEEK_SET)
+        || (dump = malloc(size)) == NULL || fread(dump, 1, size, file) != (size_t)size) {
+
+        LOG_ERROR("MIDI dump %s unreadable\n", path);
+        if (file != NULL) {
+            fclose(file);
+        }
+        free(dump);
         return -1;
     }
+    fclose(file);
+
+    sample_midi_init(&parser);
+    start = sample_queue_timestamp();
+
+    while (elapsed < 1000000000ull) {
+
+        long int offset = 0;
+        int used = 0;
+
+        while (offset < size) {
+            notes += sample_midi_parse(&parser, dump + offset, size - offset, &used, note, INPUT_MIDI_BATCH);
+            offset += used;
+        }
+        bytes += size;
+        elapsed = sample_queue_timestamp() - start;
+    }
+
+    LOG_INFO("MIDI parser: %lu bytes, %lu note-ons in %.3f s, %.1f MB/s, %.0f note-ons/s\n",
+             (unsigned long)bytes, (unsigned long)notes, elapsed / 1e9, bytes * 1e3 / elapsed, notes * 1e9 / elapsed);
+
+    sample_midi_init(&parser);
+    start = sample_queue_timestamp();
+    midi_dispatch(key_ctx, &parser, dump, size);
+    elapsed = sample_queue_timestamp() - start;
 
-    if (argc > samples_max) {
-        LOG_ERROR("Maximum %d sample allowed\n", samples_max);
+    LOG_INFO("MIDI trigger path: %lu note-ons in %.3f ms, %.0f note-ons/s, %lu dropped by a full trigger queue\n",
+             (unsigned long)key_ctx->notes, elapsed / 1e6, key_ctx->notes * 1e9 / (elapsed ? elapsed : 1), (unsigned long)key_ctx->dropped);
+
+    free(dump);
+
+    return 0;
+}
+
+// Poll the stats block of another engine process once per second until that process exits
+static int stats_watch(const char* name) {
+
+    sample_stats_t stats;
+
+    if (sample_stats_open(&stats, name)) {
         return -1;
     }
 
-    num_sample_trig = argc -1;
+    while (kill(stats.block->pid, 0) == 0 || errno == EPERM) {
+        sample_stats_print(stats.block);
+        sleep(1);
+    }
+
+    LOG_INFO("Stats %s: engine %d exited\n", name, (int)stats.block->pid);
+    sample_stats_close(&stats);
 
-    if (sample_trig_init(sample_list, argv, num_sample_trig)) {
+    return 0;
+}
+
+// <MiB>[:<head ms>[:<read-ahead ms>]]
+static int parse_stream(const char* arg, sample_trig_config_t* config) {
+
+    double threshold_mib = 0;
+
+    if (sscanf(arg, "%lf:%d:%d", &threshold_mib, &config->stream_head_ms, &config->stream_ahead_ms) < 1
+        || threshold_mib <= 0 || config->stream_head_ms < 0 || config->stream_ahead_ms < 0) {
+
+        LOG_ERROR("Invalid stream option %s\n", arg);
         return -1;
     }
 
+    config->stream_threshold = threshold_mib * 1024 * 1024;
+
+    return 0;
+}
+
+// Fire triggers round robin over the samples with a pseudo random, reproducible spacing
+// so they land on every phase of the period
+static int latency_harness(sample_trig_t** sample_list, int num_sample, int count) {
+
+    int i = 0;
+    unsigned int seed = 1;
+    struct timespec interval = {0};
+
+    LOG_INFO("Latency harness: firing %d triggers\n", count);
+
+    for (i=0;i<count;i++) {
+
+        if (sample_trig(sample_list, i % num_sample)) {
+            LOG_WARN("Latency harness: trigger %d dropped\n", i);
+        }
+
+        long int interval_us = LATENCY_INTERVAL_MIN_US + rand_r(&seed) % (LATENCY_INTERVAL_MAX_US - LATENCY_INTERVAL_MIN_US);
+        interval.tv_nsec = interval_us * 1000;
+        nanosleep(&interval, NULL);
+    }
+
+    // let the last voices reach the device before the report
     sleep(1);
 
-    int quit = 0;
-    char key_trig[2] = {0};
+    return sample_trig_exit(sample_list, num_sample);
+}
 
-    while (quit == 0) {
+int main(int argc, char* argv[]) {
 
-        read(0, key_trig, 2);
+    int opt = 0;
+    int num_sample_trig = 0;
+    int latency_count = 0;
+    char* kit_path = NULL;
+    char* input_spec[INPUT_SOURCE_MAX];
+    int num_input = 0;
+    char* midi_dump = NULL;
+    char* replay_path = NULL;
+    sample_replay_t replay;
+    sample_input_type_t stdin_type = SAMPLE_INPUT_KEYS;
+    sample_kit_t kit;
+    sample_trig_config_t config = {0};
 
-        if (key_trig[0] == '\n')
-            continue; //filter line feed
 
-        LOG_INFO("Key trig: %c\n", key_trig[0]);
-        switch (key_trig[0]) {
+    LOG_INFO("Start of %s\n", argv[0]);
 
-            case key_trig_0:
+    while ((opt = getopt(argc, argv, "mpl:o:v:n:s:k:r:f:c:aMR:C:d:K:S:I:T:Q:P:W:j:J:")) != -1) {
 
-                if (sample_trig(sample_list, sample_0)) {
-                    continue;
-                }
+        switch (opt) {
+
+            case 'm':
+                config.bank_flags |= SAMPLE_BANK_FLAG_MMAP;
+                break;
+
+            case 'p':
+                config.bank_flags |= SAMPLE_BANK_FLAG_PREFAULT;
                 break;
 
-            case key_trig_1:
+            case 'l':
+                latency_count = atoi(optarg);
+                config.latency = 1;
+                break;
 
-                if (sample_trig(sample_list, sample_1)) {
-                    continue;
+            case 'o':
+                if (sample_output_parse(optarg, &config.output, &config.output_target)) {
+                    usage(argv[0]);
+                    return -1;
                 }
                 break;
 
-            case key_trig_2:
+            case 'v':
+                config.max_voices = atoi(optarg);
+                break;
+
+            case 'n':
+                config.polyphony = atoi(optarg);
+                break;
 
-                if (sample_trig(sample_list, sample_2)) {
-                    continue;
+            case 's':
+                if (sample_trig_parse_steal(optarg, &config.steal)) {
+                    usage(argv[0]);
+                    return -1;
                 }
                 break;
 
-            case key_trig_3:
+            case 'k':
+                config.mix_kernel = optarg;
+                break;
 
-                if (sample_trig(sample_list, sample_3)) {
-                    continue;
-                }
+            case 'r':
+                config.rate = atoi(optarg);
                 break;
 
-            case key_trig_4:
+            case 'f':
+                config.period_frames = atol(optarg);
+                break;
 
-                if (sample_trig(sample_list, sample_4)) {
-                    continue;
-                }
+            case 'c':
+                config.periods = atoi(optarg);
+                break;
+
+            case 'a':
+                config.autotune = 1;
                 break;
 
-            case key_trig_5:
+            case 'M':
+                config.mmap = 1;
+                break;
+
+            case 'R':
+                config.rt = 1;
+                config.rt_priority = atoi(optarg);
+                break;
+
+            case 'C':
+                config.rt_cpus = optarg;
+                break;
 
-                if (sample_trig(sample_list, sample_5)) {
-                    continue;
+            case 'd':
+                config.cache_dir = optarg;
+                break;
+
+            case 'K':
+                kit_path = optarg;
+                break;
+
+            case 'T':
+                midi_dump = optarg;
+                break;
+
+            case 'j':
+                config.record_path = optarg;
+                break;
+
+            case 'J':
+                replay_path = optarg;
+                config.replay = 1;
+                break;
+
+            case 'Q':
+                if (optarg[0] != '/' || strchr(optarg + 1, '/')) {
+                    LOG_ERROR("Shared memory name must be a single /name\n");
+                    return -1;
                 }
+                config.shm_name = optarg;
                 break;
 
-            case key_trig_exit:
+            case 'P':
+            case 'W':
+                if (optarg[0] != '/' || strchr(optarg + 1, '/')) {
+                    LOG_ERROR("Shared memory name must be a single /name\n");
+                    return -1;
+                }
+                if (opt == 'W') {
+                    return stats_watch(optarg);
+                }
+                config.stats_name = optarg;
+                break;
 
-                if (sample_trig_exit(sample_list, num_sample_trig)) {
-                    continue;
+            case 'I':
+                if (strcmp(optarg, "midi:-") == 0) {
+                    stdin_type = SAMPLE_INPUT_MIDI;
+                    break;
+                }
+                if (num_input == INPUT_SOURCE_MAX) {
+                    LOG_ERROR("Maximum %d inputs allowed\n", INPUT_SOURCE_MAX);
+                    return -1;
                 }
+                input_spec[num_input++] = optarg;
+                break;
 
-                quit = 1;
+            case 'S':
+                if (parse_stream(optarg, &config)) {
+                    usage(argv[0]);
+                    return -1;
+                }
                 break;
 
             default:
-                //Otherwise, ignore other input keys
-                break;
+                usage(argv[0]);
+                return -1;
+        }
+    }
+
+    sample_kit_init(&kit);
+
+    if (kit_path != NULL && sample_kit_load(&kit, kit_path)) {
+        sample_kit_deinit(&kit);
+        return -1;
+    }
+
+    for (int i=optind;i<argc;i++) {
+
+        int index = i - optind;
+        int key = (index < (int)strlen(KEY_TRIG_DEFAULT)) ? KEY_TRIG_DEFAULT[index] : SAMPLE_KIT_KEY_NONE;
+
+        // kit keys take precedence over the default ones
+        if (key != SAMPLE_KIT_KEY_NONE && sample_kit_key(&kit, key) >= 0) {
+            key = SAMPLE_KIT_KEY_NONE;
         }
 
-        usleep(10000);
+        int note = MIDI_NOTE_DEFAULT + index;
+
+        if (note >= SAMPLE_MIDI_NOTE_MAX || sample_kit_note(&kit, note) >= 0) {
+            note = SAMPLE_KIT_NOTE_NONE;
+        }
+
+        if (sample_kit_add(&kit, NULL, argv[i], key, note) < 0) {
+            sample_kit_deinit(&kit);
+            return -1;
+        }
+    }
+
+    num_sample_trig = kit.num_sample;
+
+    if (num_sample_trig <= 0) {
+        usage(argv[0]);
+        sample_kit_deinit(&kit);
+        return -1;
+    }
+
+    // a replay renders with the recorded rate and period unless told otherwise
+    if (replay_path != NULL) {
+
+        if (config.output == SAMPLE_OUTPUT_ALSA) {
+            LOG_ERROR("Replay renders offline, select -o null or -o wav[:<file>]\n");
+            sample_kit_deinit(&kit);
+            return -1;
+        }
+
+        if (sample_replay_open(&replay, replay_path)) {
+            sample_kit_deinit(&kit);
+            return -1;
+        }
+
+        if (replay.header.num_sample != (uint32_t)num_sample_trig) {
+            LOG_WARN("Replay: recorded with %u samples, the kit has %d\n", replay.header.num_sample, num_sample_trig);
+        }
+
+        config.rate = config.rate ? config.rate : replay.header.rate;
+        config.period_frames = config.period_frames ? config.period_frames : replay.header.period_frames;
+    }
+
+    // the engine thread logs through the asynchronous log thread
+    if (log_async_start()) {
+        LOG_WARN("Asynchronous log start failed, engine logs are written synchronously\n");
+    }
+
+    if (sample_trig_init(kit.sample, kit.path, num_sample_trig, &config)) {
+        if (replay_path != NULL) {
+            sample_replay_close(&replay);
+        }
+        log_async_stop();
+        sample_kit_deinit(&kit);
+        return -1;
+    }
+
+    if (replay_path != NULL) {
+        int ret = sample_trig_replay(kit.sample, &replay);
+        sample_replay_close(&replay);
+        sample_trig_exit(kit.sample, num_sample_trig);
+        log_async_stop();
+        sample_kit_deinit(&kit);
+        return ret;
+    }
+
+    sleep(1);
+
+    if (latency_count > 0) {
+        int ret = latency_harness(kit.sample, num_sample_trig, latency_count);
+        log_async_stop();
+        sample_kit_deinit(&kit);
+        return ret;
+    }
+
+    sample_input_t input;
+    sample_input_t* input_ptr = &input;
+    key_ctx_t key_ctx = {&kit, 0, 0, 0};
+
+    if (midi_dump != NULL) {
+        int ret = midi_dump_test(midi_dump, &key_ctx);
+        sample_trig_exit(kit.sample, num_sample_trig);
+        log_async_stop();
+        sample_kit_deinit(&kit);
+        return ret;
+    }
+
+    if (sample_input_init(&input, key_dispatch, &key_ctx) || sample_input_add_stdin(&input, stdin_type)) {
+        input_ptr = NULL;
+    }
+
+    for (int i=0;input_ptr != NULL && i<num_input;i++) {
+        if (sample_input_add(&input, input_spec[i])) {
+            input_ptr = NULL;
+        }
+    }
+
+    if (input_ptr == NULL || sample_input_run(&input)) {
+        LOG_ERROR("Input failure\n");
+    }
+
+    sample_input_deinit(&input);
+
+    if (key_ctx.exited == 0) {
+        sample_trig_exit(kit.sample, num_sample_trig);
     }
 
-    sleep(1); // TODO wait thread to exit (workaround)
+    log_async_stop();
+    sample_kit_deinit(&kit);
 
     LOG_INFO("EOP\n");
     return 0;
@@ -0,0 +1,401 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "sample_bank.h"
+#include "sample_src.h"
+#include "log.h"
+
+void sample_bank_print_info(sample_buffer_t* buffer) {
+
+    LOG_INFO("Sample bank entry:\n"
+            " path              : %s\n"
+            " numbers of frames : %ld\n"
+            " sample rates      : %d\n"
+            " channels          : %d\n"
+            " resident memory   : %zu bytes\n"
+            " shared mapping    : %zu bytes\n"
+            "\n",
+            buffer->path,
+            buffer->num_frames,
+            buffer->rate,
+            buffer->channels,
+            buffer->mem_size,
+            buffer->map_size);
+}
+
+static int sample_bank_wav_find_chunk(int fd, off_t file_size, const char* id, off_t* chunk_offset, unsigned int* chunk_size) {
+
+    unsigned char header[8];
+    off_t offset = 12; // skip RIFF header
+
+    while (offset + 8 <= file_size) {
+
+        if (pread(fd, header, sizeof(header), offset) != sizeof(header)) {
+            return -1;
+        }
+
+        unsigned int size = header[4] | header[5] << 8 | header[6] << 16 | (unsigned int)header[7] << 24;
+
+        if (memcmp(header, id, 4) == 0) {
+            *chunk_offset = offset + 8;
+            *chunk_size = size;
+            return 0;
+        }
+
+        // chunks are word aligned
+        offset += 8 + size + (size & 1);
+    }
+
+    return -1;
+}
+
+// Fault every page of the sample in, mapped samples are also read ahead by the kernel
+void sample_bank_prefault(sample_buffer_t* buffer) {
+
+    size_t i = 0;
+    long page_size = sysconf(_SC_PAGESIZE);
+    volatile const char* page = (const char*)buffer->pcm;
+    size_t size = buffer->num_frames * buffer->channels * sizeof(short);
+
+    if (buffer->map_addr != NULL) {
+
+        if (madvise(buffer->map_addr, buffer->map_size, MADV_WILLNEED)) {
+            LOG_WARN("Sample bank madvise %s: %s\n", buffer->path, strerror(errno));
+        }
+
+        page = (const char*)buffer->map_addr;
+        size = buffer->map_size;
+    }
+
+    for (i=0;i<size;i+=page_size) {
+        (void)page[i];
+    }
+}
+
+static int sample_bank_map(sample_buffer_t* buffer, char* file_path, int flags) {
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    LOG_INFO("Sample bank mmap needs a little-endian host\n");
+    return -1;
+#endif
+
+    struct stat file_stat;
+    unsigned char fmt[16];
+    off_t fmt_offset = 0;
+    off_t data_offset = 0;
+    unsigned int fmt_size = 0;
+    unsigned int data_size = 0;
+
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("Sample bank open %s: %s\n", file_path, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(fd, &file_stat)
+        || pread(fd, fmt, 12, 0) != 12
+        || memcmp(fmt, "RIFF", 4) || memcmp(fmt + 8, "WAVE", 4)
+        || sample_bank_wav_find_chunk(fd, file_stat.st_size, "fmt ", &fmt_offset, &fmt_size)
+        || fmt_size < sizeof(fmt)
+        || pread(fd, fmt, sizeof(fmt), fmt_offset) != sizeof(fmt)
+        || sample_bank_wav_find_chunk(fd, file_stat.st_size, "data", &data_offset, &data_size)) {
+
+        LOG_INFO("Sample bank %s is not a canonical WAV file\n", file_path);
+        close(fd);
+        return -1;
+    }
+
+    unsigned int format_tag = fmt[0] | fmt[1] << 8;
+    unsigned int channels = fmt[2] | fmt[3] << 8;
+    unsigned int rate = fmt[4] | fmt[5] << 8 | fmt[6] << 16 | (unsigned int)fmt[7] << 24;
+    unsigned int bits = fmt[14] | fmt[15] << 8;
+
+    // only plain PCM (format tag 1) can be played straight from the file
+    if (format_tag != 1 || bits != 16 || channels == 0) {
+
+        LOG_INFO("Sample bank %s is not WAV S16_LE\n", file_path);
+        close(fd);
+        return -1;
+    }
+
+    if (data_offset + data_size > file_stat.st_size) {
+        data_size = file_stat.st_size - data_offset;
+    }
+
+    buffer->map_size = file_stat.st_size;
+    buffer->map_addr = mmap(NULL, buffer->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (buffer->map_addr == MAP_FAILED) {
+
+        LOG_ERROR("Sample bank mmap %s: %s\n", file_path, strerror(errno));
+        buffer->map_addr = NULL;
+        buffer->map_size = 0;
+        return -1;
+    }
+
+    buffer->path = strdup(file_path);
+    buffer->pcm = (short*)((char*)buffer->map_addr + data_offset);
+    buffer->num_frames = data_size / (channels * sizeof(short));
+    buffer->channels = channels;
+    buffer->rate = rate;
+    buffer->mem_size = 0;
+
+    if (flags & SAMPLE_BANK_FLAG_PREFAULT) {
+        sample_bank_prefault(buffer);
+    }
+
+    return 0;
+}
+
+static int sample_bank_decode(sample_buffer_t* buffer, char* file_path) {
+
+    audio_file_t file = {0};
+    long int frame_count = 0;
+
+    if (hal_sndfile_open(&file, file_path)) {
+
+        LOG_ERROR("Sample bank open failed for %s\n", file_path);
+        hal_sndfile_close(&file);
+        return -1;
+    }
+
+    // any format libsndfile decodes is converted to the internal S16 format in the same pass
+    hal_sndfile_set_clipping(&file);
+
+    // Decode the whole file once, the aligned file buffer becomes the bank entry
+    frame_count = hal_sndfile_read(&file, file.info.frames);
+    if (frame_count != file.info.frames) {
+        LOG_WARN("Sample bank short read for %s: %ld/%ld frames\n", file_path, frame_count, (long int)file.info.frames);
+    }
+
+    buffer->pcm = file.buffer;
+    buffer->num_frames = frame_count;
+    buffer->channels = file.info.channels;
+    buffer->rate = file.info.samplerate;
+    buffer->mem_size = file.info.frames * file.info.channels * sizeof(short);
+    buffer->path = file.path;
+
+    file.buffer = NULL;
+    file.path = NULL;
+    hal_sndfile_close(&file);
+
+    return 0;
+}
+
+int sample_bank_load(sample_buffer_t* buffer, char* file_path, int flags) {
+
+    memset(buffer, 0, sizeof(sample_buffer_t));
+
+    if (flags & SAMPLE_BANK_FLAG_MMAP) {
+
+        if (sample_bank_map(buffer, file_path, flags) == 0) {
+
+            sample_bank_print_info(buffer);
+            return 0;
+        }
+
+        LOG_INFO("Sample bank: fall back to decoding %s\n", file_path);
+    }
+
+    if (sample_bank_decode(buffer, file_path)) {
+        return -1;
+    }
+
+    sample_bank_print_info(buffer);
+
+    return 0;
+}
+
+void sample_bank_unload(sample_buffer_t* buffer) {
+
+    if (buffer->map_addr != NULL) {
+        munmap(buffer->map_addr, buffer->map_size);
+    } else {
+        free(buffer->pcm);
+    }
+    free(buffer->path);
+    memset(buffer, 0, sizeof(sample_buffer_t));
+}
+
+// Convert a bank entry to the output rate once, playback then stays a plain copy at the device rate.
+// Mapped samples are replaced by a resident copy.
+int sample_bank_resample(sample_buffer_t* buffer, int rate) {
+
+    short* pcm = NULL;
+    long int num_frames = 0;
+    struct timespec start, stop;
+    size_t old_size = buffer->mem_size + buffer->map_size;
+
+    if (buffer->rate == rate) {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (sample_src_convert(buffer->pcm, buffer->num_frames, buffer->channels, buffer->rate, rate, &pcm, &num_frames)) {
+
+        LOG_ERROR("Sample bank resample %s failed\n", buffer->path);
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    if (buffer->map_addr != NULL) {
+
+        munmap(buffer->map_addr, buffer->map_size);
+        buffer->map_addr = NULL;
+        buffer->map_size = 0;
+    } else {
+        free(buffer->pcm);
+    }
+
+    LOG_INFO("Sample bank resample %s: %d -> %d Hz, %ld -> %ld frames in %.2f ms, memory %+ld bytes\n",
+             buffer->path, buffer->rate, rate, buffer->num_frames, num_frames,
+             (stop.tv_sec - start.tv_sec) * 1e3 + (stop.tv_nsec - start.tv_nsec) / 1e6,
+             (long int)(num_frames * buffer->channels * sizeof(short)) - (long int)old_size);
+
+    buffer->pcm = pcm;
+    buffer->num_frames = num_frames;
+    buffer->rate = rate;
+    buffer->mem_size = num_frames * buffer->channels * sizeof(short);
+
+    return 0;
+}
+
+// Up or down mix frames: mono is copied on every channel, a single output channel gets the
+// average of all inputs, otherwise extra inputs are folded onto output channel (input % channels)
+// and extra outputs repeat the inputs.
+void sample_bank_mix_channels(short* dst, int channels, const short* src, int in_channels, long int num_frames) {
+
+    long int i = 0;
+    int in = 0;
+    int out = 0;
+
+    for (i=0;i<num_frames;i++) {
+
+        for (out=0;out<channels;out++) {
+
+            int sum = 0;
+            int count = 0;
+
+            if (in_channels < channels) {
+                dst[out] = src[out % in_channels];
+                continue;
+            }
+
+            for (in=out;in<in_channels;in+=channels) {
+                sum += src[in];
+                count++;
+            }
+            dst[out] = sum / count;
+        }
+
+        src += in_channels;
+        dst += channels;
+    }
+}
+
+// Mix a bank entry to the output channel count once, playback then copies frames as they are
+int sample_bank_set_channels(sample_buffer_t* buffer, int channels) {
+
+    short* pcm = NULL;
+    int in_channels = buffer->channels;
+    size_t old_size = buffer->mem_size + buffer->map_size;
+    size_t size = buffer->num_frames * channels * sizeof(short);
+
+    if (in_channels == channels) {
+        return 0;
+    }
+
+    if (posix_memalign((void**)&pcm, HAL_SNDFILE_BUFFER_ALIGN, size)) {
+
+        LOG_ERROR("Sample bank %s channel conversion allocation failed\n", buffer->path);
+        return -1;
+    }
+
+    sample_bank_mix_channels(pcm, channels, buffer->pcm, in_channels, buffer->num_frames);
+
+    if (buffer->map_addr != NULL) {
+
+        munmap(buffer->map_addr, buffer->map_size);
+        buffer->map_addr = NULL;
+        buffer->map_size = 0;
+    } else {
+        free(buffer->pcm);
+    }
+
+    LOG_INFO("Sample bank %s: %d -> %d channels, memory %+ld bytes\n",
+             buffer->path, in_channels, channels, (long int)size - (long int)old_size);
+
+    buffer->pcm = pcm;
+    buffer->channels = channels;
+    buffer->mem_size = size;
+
+    return 0;
+}
+
+// Decode only the first head_ms of files whose decoded size exceeds threshold bytes, the rest
+// is streamed from the file while playing. Returns 1 when the file is small enough to be loaded.
+int sample_bank_load_head(sample_buffer_t* buffer, char* file_path, size_t threshold, int head_ms) {
+
+    audio_file_t file = {0};
+    long int head_frames = 0;
+    size_t size = 0;
+
+    memset(buffer, 0, sizeof(sample_buffer_t));
+
+    if (hal_sndfile_open_stream(&file, file_path, 0)) {
+
+        hal_sndfile_close(&file);
+        return -1;
+    }
+
+    size = file.info.frames * file.info.channels * sizeof(short);
+    head_frames = (long int)file.info.samplerate * head_ms / 1000;
+
+    if (size <= threshold || head_frames >= file.info.frames || file.info.seekable == 0) {
+
+        hal_sndfile_close(&file);
+        return 1;
+    }
+
+    hal_sndfile_set_clipping(&file);
+
+    if (posix_memalign((void**)&file.buffer, HAL_SNDFILE_BUFFER_ALIGN, head_frames * file.info.channels * sizeof(short))) {
+
+        LOG_ERROR("Sample bank %s head allocation failed\n", file_path);
+        file.buffer = NULL;
+        hal_sndfile_close(&file);
+        return -1;
+    }
+
+    if (hal_sndfile_read(&file, head_frames) != head_frames) {
+
+        LOG_ERROR("Sample bank %s head short read\n", file_path);
+        hal_sndfile_close(&file);
+        return -1;
+    }
+
+    buffer->pcm = file.buffer;
+    buffer->num_frames = head_frames;
+    buffer->stream_frames = file.info.frames;
+    buffer->stream_channels = file.info.channels;
+    buffer->channels = file.info.channels;
+    buffer->rate = file.info.samplerate;
+    buffer->mem_size = head_frames * file.info.channels * sizeof(short);
+    buffer->path = file.path;
+
+    LOG_INFO("Sample bank %s: streamed, %ld of %ld frames resident\n", file_path, head_frames, (long int)file.info.frames);
+
+    file.buffer = NULL;
+    file.path = NULL;
+    hal_sndfile_close(&file);
+
+    return 0;
+}
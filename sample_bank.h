@@ -0,0 +1,36 @@
+#ifndef SAMPLE_BANK_H
+#define SAMPLE_BANK_H
+
+#include <stddef.h>
+#include "hal_sndfile.h"
+
+// Load flags
+#define SAMPLE_BANK_FLAG_MMAP       0x01    // map canonical WAV S16_LE files instead of decoding them
+#define SAMPLE_BANK_FLAG_PREFAULT   0x02    // fault mapped pages in at load time
+
+// Sample decoded in memory, or only its head when streamed, playback only moves a frame cursor over it
+typedef struct sample_buffer {
+
+    short*      pcm;
+    long int    num_frames;
+    int         channels;
+    int         rate;
+    size_t      mem_size;
+    char*       path;
+    void*       map_addr;
+    size_t      map_size;
+    long int    stream_frames;      // total frames of a streamed sample, pcm only holds its head
+    int         stream_channels;    // file channels of a streamed sample
+
+} sample_buffer_t;
+
+int sample_bank_load(sample_buffer_t* buffer, char* file_path, int flags);
+void sample_bank_unload(sample_buffer_t* buffer);
+void sample_bank_print_info(sample_buffer_t* buffer);
+void sample_bank_prefault(sample_buffer_t* buffer);
+int sample_bank_resample(sample_buffer_t* buffer, int rate);
+int sample_bank_set_channels(sample_buffer_t* buffer, int channels);
+void sample_bank_mix_channels(short* dst, int channels, const short* src, int in_channels, long int num_frames);
+int sample_bank_load_head(sample_buffer_t* buffer, char* file_path, size_t threshold, int head_ms);
+
+#endif /* SAMPLE_BANK_H */
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sample_cache.h"
+#include "log.h"
+
+_Static_assert(sizeof(sample_cache_header_t) <= SAMPLE_CACHE_DATA_OFFSET, "cache header overlaps the pcm data");
+
+// Resolve the source path and stat it, the resolved path names the cache entry
+static int sample_cache_source(const char* file_path, char* real_path, struct stat* file_stat) {
+
+    if (realpath(file_path, real_path) == NULL || strlen(real_path) >= SAMPLE_CACHE_PATH_MAX) {
+
+        LOG_WARN("Sample cache: resolve %s: %s\n", file_path, strerror(errno));
+        return -1;
+    }
+
+    if (stat(real_path, file_stat)) {
+
+        LOG_WARN("Sample cache: stat %s: %s\n", real_path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+// Entry file name: FNV-1a hash of the resolved source path plus the engine format
+static void sample_cache_entry_name(char* name, size_t size, const char* cache_dir, const char* real_path, int rate, int channels) {
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const unsigned char* c = (const unsigned char*)real_path;
+
+    while (*c) {
+        hash = (hash ^ *c++) * 0x100000001b3ULL;
+    }
+
+    snprintf(name, size, "%s/%016llx-%d-%d.smp", cache_dir, (unsigned long long)hash, rate, channels);
+}
+
+int sample_cache_load(sample_buffer_t* buffer, const char* cache_dir, const char* file_path, int rate, int channels, int flags) {
+
+    int fd = -1;
+    size_t data_size = 0;
+    struct stat src_stat;
+    struct stat cache_stat;
+    sample_cache_header_t header;
+    char real_path[PATH_MAX];
+    char name[PATH_MAX];
+
+    if (sample_cache_source(file_path, real_path, &src_stat)) {
+        return -1;
+    }
+
+    sample_cache_entry_name(name, sizeof(name), cache_dir, real_path, rate, channels);
+
+    fd = open(name, O_RDONLY);
+    if (fd < 0) {
+
+        LOG_DEBUG("Sample cache miss for %s\n", file_path);
+        return -1;
+    }
+
+    if (fstat(fd, &cache_stat) || pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+
+        LOG_INFO("Sample cache: %s unreadable\n", name);
+        close(fd);
+        return -1;
+    }
+
+    header.src_path[SAMPLE_CACHE_PATH_MAX - 1] = '\0';
+    data_size = header.num_frames * header.channels * sizeof(short);
+
+    // any change of the source or the engine format invalidates the entry, the next store replaces it
+    if (memcmp(header.magic, SAMPLE_CACHE_MAGIC, sizeof(header.magic))
+        || header.version != SAMPLE_CACHE_VERSION
+        || header.data_offset != SAMPLE_CACHE_DATA_OFFSET
+        || header.rate != (uint32_t)rate
+        || header.channels != (uint32_t)channels
+        || header.src_size != (uint64_t)src_stat.st_size
+        || header.src_mtime_sec != (int64_t)src_stat.st_mtim.tv_sec
+        || header.src_mtime_nsec != (int64_t)src_stat.st_mtim.tv_nsec
+        || strcmp(header.src_path, real_path)
+        || (uint64_t)cache_stat.st_size < header.data_offset + data_size) {
+
+        LOG_INFO("Sample cache: stale entry for %s\n", file_path);
+        close(fd);
+        return -1;
+    }
+
+    memset(buffer, 0, sizeof(sample_buffer_t));
+    buffer->map_size = cache_stat.st_size;
+    buffer->map_addr = mmap(NULL, buffer->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (buffer->map_addr == MAP_FAILED) {
+
+        LOG_ERROR("Sample cache mmap %s: %s\n", name, strerror(errno));
+        memset(buffer, 0, sizeof(sample_buffer_t));
+        return -1;
+    }
+
+    buffer->path = strdup(file_path);
+    buffer->pcm = (short*)((char*)buffer->map_addr + header.data_offset);
+    buffer->num_frames = header.num_frames;
+    buffer->channels = header.channels;
+    buffer->rate = header.rate;
+    buffer->mem_size = 0;
+
+    if (flags & SAMPLE_BANK_FLAG_PREFAULT) {
+        sample_bank_prefault(buffer);
+    }
+
+    sample_bank_print_info(buffer);
+
+    return 0;
+}
+
+static int sample_cache_write(int fd, const void* data, size_t size, off_t offset) {
+
+    const char* p = data;
+
+    while (size > 0) {
+
+        ssize_t ret = pwrite(fd, p, size, offset);
+        if (ret < 0) {
+
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        p += ret;
+        offset += ret;
+        size -= ret;
+    }
+
+    return 0;
+}
+
+// Write a converted bank entry, the entry is written aside and renamed in place
+// so concurrent starts never map a partial file
+int sample_cache_store(sample_buffer_t* buffer, const char* cache_dir, const char* file_path) {
+
+    int fd = -1;
+    int ret = 0;
+    struct stat src_stat;
+    sample_cache_header_t header = {0};
+    size_t data_size = buffer->num_frames * buffer->channels * sizeof(short);
+    char real_path[PATH_MAX];
+    char name[PATH_MAX];
+    char tmp_name[PATH_MAX + 8];
+
+    if (sample_cache_source(file_path, real_path, &src_stat)) {
+        return -1;
+    }
+
+    if (mkdir(cache_dir, 0755) && errno != EEXIST) {
+
+        LOG_ERROR("Sample cache: create %s: %s\n", cache_dir, strerror(errno));
+        return -1;
+    }
+
+    sample_cache_entry_name(name, sizeof(name), cache_dir, real_path, buffer->rate, buffer->channels);
+    snprintf(tmp_name, sizeof(tmp_name), "%s.XXXXXX", name);
+
+    memcpy(header.magic, SAMPLE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = SAMPLE_CACHE_VERSION;
+    header.data_offset = SAMPLE_CACHE_DATA_OFFSET;
+    header.src_size = src_stat.st_size;
+    header.src_mtime_sec = src_stat.st_mtim.tv_sec;
+    header.src_mtime_nsec = src_stat.st_mtim.tv_nsec;
+    header.rate = buffer->rate;
+    header.channels = buffer->channels;
+    header.num_frames = buffer->num_frames;
+    strcpy(header.src_path, real_path);
+
+    fd = mkstemp(tmp_name);
+    if (fd < 0) {
+
+        LOG_ERROR("Sample cache: create %s: %s\n", tmp_name, strerror(errno));
+        return -1;
+    }
+
+    ret = sample_cache_write(fd, &header, sizeof(header), 0)
+          || sample_cache_write(fd, buffer->pcm, data_size, SAMPLE_CACHE_DATA_OFFSET)
+          || fchmod(fd, 0644);
+
+    if (close(fd) || ret || rename(tmp_name, name)) {
+
+        LOG_ERROR("Sample cache: write %s: %s\n", name, strerror(errno));
+        unlink(tmp_name);
+        return -1;
+    }
+
+    LOG_INFO("Sample cache: stored %s as %s\n", file_path, name);
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef SAMPLE_CACHE_H
+#define SAMPLE_CACHE_H
+
+#include <stdint.h>
+#include "sample_bank.h"
+
+// On-disk cache of samples already decoded, resampled and channel mixed to the engine format.
+// One file per source and engine format, mapped as is on a warm start.
+
+#define SAMPLE_CACHE_MAGIC          "SMPCACHE"
+#define SAMPLE_CACHE_VERSION        1
+#define SAMPLE_CACHE_DATA_OFFSET    4096    // pcm starts on a page boundary
+#define SAMPLE_CACHE_PATH_MAX       1024
+
+// File header, native endianness: the cache is local to the host that wrote it
+typedef struct sample_cache_header {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    data_offset;
+    uint64_t    src_size;           // source file size, mtime and path form the key with the format
+    int64_t     src_mtime_sec;
+    int64_t     src_mtime_nsec;
+    uint32_t    rate;
+    uint32_t    channels;
+    uint64_t    num_frames;
+    char        src_path[SAMPLE_CACHE_PATH_MAX];
+
+} sample_cache_header_t;
+
+int sample_cache_load(sample_buffer_t* buffer, const char* cache_dir, const char* file_path, int rate, int channels, int flags);
+int sample_cache_store(sample_buffer_t* buffer, const char* cache_dir, const char* file_path);
+
+#endif /* SAMPLE_CACHE_H */
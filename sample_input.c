@@ -0,0 +1,372 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "sample_input.h"
+#include "log.h"
+
+#define SAMPLE_INPUT_EVENTS     16
+
+static int sample_input_add_fd(sample_input_t* input, int fd, sample_input_type_t type, const char* name) {
+
+    struct epoll_event event = {0};
+    sample_input_source_t* source = NULL;
+
+    if (input->num_source >= SAMPLE_INPUT_SOURCE_MAX) {
+        LOG_ERROR("Input %s: more than %d sources\n", name, SAMPLE_INPUT_SOURCE_MAX);
+        return -1;
+    }
+
+    source = calloc(1, sizeof(sample_input_source_t));
+    if (source == NULL || (source->name = strdup(name)) == NULL) {
+        LOG_ERROR("Input %s: %s\n", name, strerror(errno));
+        free(source);
+        return -1;
+    }
+    source->fd = fd;
+    source->type = type;
+    sample_midi_init(&source->midi);
+
+    event.events = EPOLLIN;
+    event.data.ptr = source;
+
+    if (epoll_ctl(input->epfd, EPOLL_CTL_ADD, fd, &event)) {
+
+        LOG_ERROR("Input %s: epoll add: %s\n", name, strerror(errno));
+        free(source->name);
+        free(source);
+        return -1;
+    }
+
+    input->source[input->num_source++] = source;
+    LOG_INFO("Input: %s added\n", name);
+
+    return 0;
+}
+
+static void sample_input_remove(sample_input_t* input, sample_input_source_t* source) {
+
+    int i = 0;
+
+    for (i=0;i<input->num_source;i++) {
+
+        if (input->source[i] == source) {
+            input->source[i] = input->source[--input->num_source];
+            break;
+        }
+    }
+
+    LOG_INFO("Input: %s closed\n", source->name);
+
+    // stdin stays open for the terminal restore
+    if (source->fd != STDIN_FILENO) {
+        close(source->fd);
+    } else {
+        epoll_ctl(input->epfd, EPOLL_CTL_DEL, source->fd, NULL);
+    }
+    free(source->name);
+    free(source);
+}
+
+int sample_input_init(sample_input_t* input, sample_input_read_t read, void* ctx) {
+
+    memset(input, 0, sizeof(sample_input_t));
+    input->read = read;
+    input->ctx = ctx;
+
+    input->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (input->epfd < 0) {
+        LOG_ERROR("Input epoll create: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+// Terminals are switched to non-canonical mode without echo so every key press is read at once,
+// signals keep working
+int sample_input_add_stdin(sample_input_t* input, sample_input_type_t type) {
+
+    struct stat file_stat;
+
+    input->stdin_type = type;
+
+    // regular files and devices such as /dev/null cannot be polled, they are read through before the loop waits
+    if (fstat(STDIN_FILENO, &file_stat) == 0
+        && (S_ISREG(file_stat.st_mode) || (S_ISCHR(file_stat.st_mode) && !isatty(STDIN_FILENO)))) {
+        input->stdin_file = 1;
+        return 0;
+    }
+
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &input->tty_saved) == 0) {
+
+        struct termios tty = input->tty_saved;
+
+        tty.c_lflag &= ~(ICANON | ECHO);
+        tty.c_cc[VMIN] = 1;
+        tty.c_cc[VTIME] = 0;
+
+        if (tcsetattr(STDIN_FILENO, TCSANOW, &tty)) {
+            LOG_WARN("Input: raw terminal mode: %s\n", strerror(errno));
+        } else {
+            input->tty_raw = 1;
+        }
+    }
+
+    return sample_input_add_fd(input, STDIN_FILENO, type, "stdin");
+}
+
+// Opened read-write so the fifo never reports end of file between writers
+static int sample_input_open_fifo(const char* path) {
+
+    if (mkfifo(path, 0660) && errno != EEXIST) {
+        LOG_ERROR("Input fifo %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERROR("Input fifo %s: %s\n", path, strerror(errno));
+    }
+
+    return fd;
+}
+
+static int sample_input_listen(int fd, const struct sockaddr* addr, socklen_t addr_len, const char* name) {
+
+    int one = 1;
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if (bind(fd, addr, addr_len) || listen(fd, SAMPLE_INPUT_LISTEN_BACKLOG)) {
+
+        LOG_ERROR("Input %s: %s\n", name, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int sample_input_open_unix(const char* path) {
+
+    struct stat file_stat;
+    struct sockaddr_un addr = {0};
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        LOG_ERROR("Input socket path %s too long\n", path);
+        return -1;
+    }
+
+    // only a stale socket is replaced
+    if (stat(path, &file_stat) == 0 && S_ISSOCK(file_stat.st_mode)) {
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR("Input socket %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    return sample_input_listen(fd, (struct sockaddr*)&addr, sizeof(addr), path);
+}
+
+// [<ipv4 address>:]<port>, loopback by default
+static int sample_input_open_tcp(const char* spec) {
+
+    struct sockaddr_in addr = {0};
+    const char* port = strrchr(spec, ':');
+    char host[INET_ADDRSTRLEN] = "127.0.0.1";
+
+    if (port != NULL) {
+        snprintf(host, sizeof(host), "%.*s", (int)(port - spec), spec);
+        port++;
+    } else {
+        port = spec;
+    }
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(port));
+
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1 || addr.sin_port == 0) {
+        LOG_ERROR("Input tcp address %s invalid\n", spec);
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR("Input tcp %s: %s\n", spec, strerror(errno));
+        return -1;
+    }
+
+    return sample_input_listen(fd, (struct sockaddr*)&addr, sizeof(addr), spec);
+}
+
+// Raw MIDI device, or a fifo when the path does not exist yet
+static int sample_input_open_midi(const char* path) {
+
+    struct stat file_stat;
+
+    if (stat(path, &file_stat) || S_ISFIFO(file_stat.st_mode)) {
+        return sample_input_open_fifo(path);
+    }
+
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERROR("Input MIDI %s: %s\n", path, strerror(errno));
+    }
+
+    return fd;
+}
+
+// fifo:<path>, unix:<path>, tcp:[<address>:]<port> or midi:<path>
+int sample_input_add(sample_input_t* input, const char* spec) {
+
+    int fd = -1;
+    sample_input_type_t type = SAMPLE_INPUT_KEYS;
+
+    if (strncmp(spec, "fifo:", 5) == 0) {
+
+        fd = sample_input_open_fifo(spec + 5);
+
+    } else if (strncmp(spec, "midi:", 5) == 0) {
+
+        fd = sample_input_open_midi(spec + 5);
+        type = SAMPLE_INPUT_MIDI;
+
+    } else if (strncmp(spec, "unix:", 5) == 0) {
+
+        fd = sample_input_open_unix(spec + 5);
+        type = SAMPLE_INPUT_LISTEN;
+
+    } else if (strncmp(spec, "tcp:", 4) == 0) {
+
+        fd = sample_input_open_tcp(spec + 4);
+        type = SAMPLE_INPUT_LISTEN;
+
+    } else {
+
+        LOG_ERROR("Input %s unknown, expected fifo:, unix:, tcp: or midi:\n", spec);
+        return -1;
+    }
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (sample_input_add_fd(input, fd, type, spec)) {
+        close(fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void sample_input_accept(sample_input_t* input, sample_input_source_t* source) {
+
+    char name[256];
+    int fd = accept4(source->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (fd < 0) {
+        if (errno != EAGAIN && errno != EINTR) {
+            LOG_WARN("Input %s accept: %s\n", source->name, strerror(errno));
+        }
+        return;
+    }
+
+    snprintf(name, sizeof(name), "%s#%d", source->name, fd);
+    if (sample_input_add_fd(input, fd, SAMPLE_INPUT_KEYS, name)) {
+        close(fd);
+    }
+}
+
+// Dispatch until the handler stops the loop or every source is closed
+int sample_input_run(sample_input_t* input) {
+
+    int i = 0;
+    int num_event = 0;
+    struct epoll_event event[SAMPLE_INPUT_EVENTS];
+    unsigned char buffer[SAMPLE_INPUT_READ_SIZE];
+    ssize_t count = 0;
+    sample_input_source_t stdin_source = {STDIN_FILENO, input->stdin_type, "stdin"};
+
+    sample_midi_init(&stdin_source.midi);
+
+    while (input->stdin_file && (count = read(STDIN_FILENO, buffer, sizeof(buffer))) > 0) {
+
+        if (input->read(input->ctx, &stdin_source, buffer, count)) {
+            return 0;
+        }
+    }
+    input->stdin_file = 0;
+
+    while (input->num_source > 0) {
+
+        num_event = epoll_wait(input->epfd, event, SAMPLE_INPUT_EVENTS, -1);
+        if (num_event < 0) {
+
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Input epoll wait: %s\n", strerror(errno));
+            return -1;
+        }
+
+        for (i=0;i<num_event;i++) {
+
+            sample_input_source_t* source = event[i].data.ptr;
+
+            if (source->type == SAMPLE_INPUT_LISTEN) {
+                sample_input_accept(input, source);
+                continue;
+            }
+
+            count = read(source->fd, buffer, sizeof(buffer));
+
+            if (count > 0) {
+
+                if (input->read(input->ctx, source, buffer, count)) {
+                    return 0;
+                }
+
+            } else if (count == 0 || (errno != EAGAIN && errno != EINTR)) {
+
+                sample_input_remove(input, source);
+            }
+        }
+    }
+
+    LOG_INFO("Input: no source left\n");
+
+    return 0;
+}
+
+void sample_input_deinit(sample_input_t* input) {
+
+    while (input->num_source > 0) {
+        sample_input_remove(input, input->source[0]);
+    }
+
+    if (input->tty_raw) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &input->tty_saved);
+    }
+
+    if (input->epfd >= 0) {
+        close(input->epfd);
+    }
+    memset(input, 0, sizeof(sample_input_t));
+    input->epfd = -1;
+}
@@ -0,0 +1,53 @@
+#ifndef SAMPLE_INPUT_H
+#define SAMPLE_INPUT_H
+
+#include <termios.h>
+#include "sample_midi.h"
+
+// Event driven trigger input: every source is a non-blocking fd in one epoll set,
+// ready sources are read in batches and handed to the handler without delay
+
+#define SAMPLE_INPUT_SOURCE_MAX     32
+#define SAMPLE_INPUT_READ_SIZE      4096    // bytes read per ready source and wake up
+#define SAMPLE_INPUT_LISTEN_BACKLOG 8
+
+typedef enum sample_input_type {
+    SAMPLE_INPUT_KEYS=0,    // one trigger key per byte
+    SAMPLE_INPUT_MIDI,      // MIDI byte stream
+    SAMPLE_INPUT_LISTEN,    // listening socket, accepted connections become key sources
+
+    SAMPLE_INPUT_MAX_TYPE,
+
+} sample_input_type_t;
+
+typedef struct sample_input_source {
+    int                 fd;
+    sample_input_type_t type;
+    char*               name;
+    sample_midi_parser_t midi;      // running status kept across reads
+
+} sample_input_source_t;
+
+// Called with every batch read from a key or MIDI source, returns 1 to stop the input loop
+typedef int (*sample_input_read_t)(void* ctx, sample_input_source_t* source, const unsigned char* data, int count);
+
+typedef struct sample_input {
+    int                     epfd;
+    sample_input_source_t*  source[SAMPLE_INPUT_SOURCE_MAX];
+    int                     num_source;
+    int                     stdin_file;     // stdin is a regular file, read through once
+    int                     tty_raw;        // stdin terminal settings to restore
+    struct termios          tty_saved;
+    sample_input_type_t     stdin_type;
+    sample_input_read_t     read;
+    void*                   ctx;
+
+} sample_input_t;
+
+int sample_input_init(sample_input_t* input, sample_input_read_t read, void* ctx);
+int sample_input_add_stdin(sample_input_t* input, sample_input_type_t type);
+int sample_input_add(sample_input_t* input, const char* spec);
+int sample_input_run(sample_input_t* input);
+void sample_input_deinit(sample_input_t* input);
+
+#endif /* SAMPLE_INPUT_H */
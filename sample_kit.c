@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include "sample_kit.h"
+#include "log.h"
+
+#define SAMPLE_KIT_GROW_MIN     16
+
+static uint32_t sample_kit_hash(const char* name) {
+
+    uint32_t hash = 2166136261u;
+
+    while (*name) {
+        hash = (hash ^ (unsigned char)*name++) * 16777619u;
+    }
+
+    return hash;
+}
+
+// Slot of name in the index, or of the empty slot where it belongs
+static unsigned int sample_kit_slot(const sample_kit_t* kit, const char* name) {
+
+    unsigned int mask = kit->name_index_size - 1;
+    unsigned int slot = sample_kit_hash(name) & mask;
+
+    while (kit->name_index[slot] && strcmp(kit->name[kit->name_index[slot] - 1], name)) {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+static int sample_kit_grow(sample_kit_t* kit) {
+
+    int i = 0;
+    int max_sample = kit->max_sample ? kit->max_sample * 2 : SAMPLE_KIT_GROW_MIN;
+    unsigned int index_size = max_sample * 2;
+    char** name = realloc(kit->name, max_sample * sizeof(char*));
+    char** path = name ? realloc(kit->path, max_sample * sizeof(char*)) : NULL;
+    sample_trig_t** sample = path ? realloc(kit->sample, max_sample * sizeof(sample_trig_t*)) : NULL;
+    int* name_index = sample ? calloc(index_size, sizeof(int)) : NULL;
+
+    // arrays already moved stay valid, the kit keeps its old capacity on failure
+    if (name) kit->name = name;
+    if (path) kit->path = path;
+    if (sample) kit->sample = sample;
+
+    if (name_index == NULL) {
+        LOG_ERROR("Sample kit: grow to %d samples: %s\n", max_sample, strerror(errno));
+        return -1;
+    }
+
+    free(kit->name_index);
+    kit->name_index = name_index;
+    kit->name_index_size = index_size;
+    kit->max_sample = max_sample;
+
+    for (i=0;i<kit->num_sample;i++) {
+        kit->name_index[sample_kit_slot(kit, kit->name[i])] = i + 1;
+    }
+
+    return 0;
+}
+
+int sample_kit_init(sample_kit_t* kit) {
+
+    memset(kit, 0, sizeof(sample_kit_t));
+
+    return 0;
+}
+
+// Register a sample, a NULL name selects the file name without its extension. Returns its id.
+int sample_kit_add(sample_kit_t* kit, const char* name, const char* path, int key, int note) {
+
+    char base[SAMPLE_KIT_NAME_MAX];
+    unsigned int slot = 0;
+
+    if (name == NULL) {
+
+        const char* file = strrchr(path, '/');
+        file = file ? file + 1 : path;
+        snprintf(base, sizeof(base), "%.*s", (int)strcspn(file, "."), file);
+        name = base;
+    }
+
+    if (name[0] == '\0' || strlen(name) >= SAMPLE_KIT_NAME_MAX) {
+        LOG_ERROR("Sample kit: invalid name for %s\n", path);
+        return -1;
+    }
+
+    if (key != SAMPLE_KIT_KEY_NONE && (key < 0 || key > 255 || kit->key_index[key])) {
+        LOG_ERROR("Sample kit: key %c of %s already mapped\n", key, name);
+        return -1;
+    }
+
+    if (key == SAMPLE_KIT_KEY_EXIT) {
+        LOG_ERROR("Sample kit: key %c of %s already mapped to exit\n", key, name);
+        return -1;
+    }
+
+    if (note != SAMPLE_KIT_NOTE_NONE && (note < 0 || note >= SAMPLE_MIDI_NOTE_MAX || kit->note_index[note])) {
+        LOG_ERROR("Sample kit: note %d of %s invalid or already mapped\n", note, name);
+        return -1;
+    }
+
+    if (kit->num_sample == kit->max_sample && sample_kit_grow(kit)) {
+        return -1;
+    }
+
+    slot = sample_kit_slot(kit, name);
+    if (kit->name_index[slot]) {
+        LOG_ERROR("Sample kit: duplicate name %s (%s)\n", name, path);
+        return -1;
+    }
+
+    kit->name[kit->num_sample] = strdup(name);
+    kit->path[kit->num_sample] = strdup(path);
+    kit->sample[kit->num_sample] = NULL;
+
+    if (kit->name[kit->num_sample] == NULL || kit->path[kit->num_sample] == NULL) {
+
+        LOG_ERROR("Sample kit: add %s: %s\n", name, strerror(errno));
+        free(kit->name[kit->num_sample]);
+        free(kit->path[kit->num_sample]);
+        return -1;
+    }
+
+    kit->num_sample++;
+    kit->name_index[slot] = kit->num_sample;
+
+    if (key != SAMPLE_KIT_KEY_NONE) {
+        kit->key_index[key] = kit->num_sample;
+    }
+
+    if (note != SAMPLE_KIT_NOTE_NONE) {
+        kit->note_index[note] = kit->num_sample;
+    }
+
+    return kit->num_sample - 1;
+}
+
+// Kit file: one sample per line as "<name> <path> [<key>|-] [<note>]", '#' starts a comment.
+// Relative paths are relative to the kit file directory.
+int sample_kit_load(sample_kit_t* kit, const char* kit_path) {
+
+    int line_num = 0;
+    int ret = 0;
+    char* line = NULL;
+    size_t line_size = 0;
+    char path[PATH_MAX];
+    const char* dir_end = strrchr(kit_path, '/');
+    int dir_len = dir_end ? (int)(dir_end - kit_path) + 1 : 0;
+
+    FILE* file = fopen(kit_path, "r");
+    if (file == NULL) {
+        LOG_ERROR("Sample kit open %s: %s\n", kit_path, strerror(errno));
+        return -1;
+    }
+
+    while (ret == 0 && getline(&line, &line_size, file) != -1) {
+
+        char* save = NULL;
+        line_num++;
+        line[strcspn(line, "#\r\n")] = '\0';
+
+        char* name = strtok_r(line, " \t", &save);
+        char* file_path = strtok_r(NULL, " \t", &save);
+        char* key = strtok_r(NULL, " \t", &save);
+        char* note = strtok_r(NULL, " \t", &save);
+        char* end = NULL;
+        long int note_num = SAMPLE_KIT_NOTE_NONE;
+
+        if (name == NULL) {
+            continue;
+        }
+
+        if (note != NULL) {
+            note_num = strtol(note, &end, 10);
+        }
+
+        if (file_path == NULL || (key != NULL && key[1] != '\0') || (note != NULL && *end != '\0')
+            || strtok_r(NULL, " \t", &save)) {
+
+            LOG_ERROR("Sample kit %s:%d: expected <name> <path> [<key>|-] [<note>]\n", kit_path, line_num);
+            ret = -1;
+            break;
+        }
+
+        // '-' leaves the sample without a key
+        if (key != NULL && key[0] == '-') {
+            key = NULL;
+        }
+
+        if (file_path[0] == '/') {
+            snprintf(path, sizeof(path), "%s", file_path);
+        } else {
+            snprintf(path, sizeof(path), "%.*s%s", dir_len, kit_path, file_path);
+        }
+
+        if (sample_kit_add(kit, name, path, key ? (unsigned char)key[0] : SAMPLE_KIT_KEY_NONE, note_num) < 0) {
+
+            LOG_ERROR("Sample kit %s:%d: %s not added\n", kit_path, line_num, name);
+            ret = -1;
+        }
+    }
+
+    free(line);
+    fclose(file);
+
+    if (ret == 0) {
+        LOG_INFO("Sample kit %s: %d samples\n", kit_path, kit->num_sample);
+    }
+
+    return ret;
+}
+
+// Id of a sample by name, -1 when unknown
+int sample_kit_find(const sample_kit_t* kit, const char* name) {
+
+    if (kit->num_sample == 0) {
+        return -1;
+    }
+
+    return kit->name_index[sample_kit_slot(kit, name)] - 1;
+}
+
+// Id of the sample mapped to an input key, -1 when unmapped
+int sample_kit_key(const sample_kit_t* kit, int key) {
+
+    if (key < 0 || key > 255) {
+        return -1;
+    }
+
+    return kit->key_index[key] - 1;
+}
+
+// Id of the sample mapped to a MIDI note, -1 when unmapped
+int sample_kit_note(const sample_kit_t* kit, int note) {
+
+    if (note < 0 || note >= SAMPLE_MIDI_NOTE_MAX) {
+        return -1;
+    }
+
+    return kit->note_index[note] - 1;
+}
+
+void sample_kit_deinit(sample_kit_t* kit) {
+
+    int i = 0;
+
+    for (i=0;i<kit->num_sample;i++) {
+        free(kit->name[i]);
+        free(kit->path[i]);
+    }
+
+    free(kit->name);
+    free(kit->path);
+    free(kit->sample);
+    free(kit->name_index);
+    memset(kit, 0, sizeof(sample_kit_t));
+}
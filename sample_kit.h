@@ -0,0 +1,36 @@
+#ifndef SAMPLE_KIT_H
+#define SAMPLE_KIT_H
+
+#include "sample_trig.h"
+#include "sample_midi.h"
+
+// Sample registry: ids are dense indexes into the sample list handed to sample_trig_init,
+// names and keys resolve to ids through hash and direct tables sized to the loaded kit
+
+#define SAMPLE_KIT_KEY_NONE     -1
+#define SAMPLE_KIT_KEY_EXIT     'x'     // stops the engine, never mapped to a sample
+#define SAMPLE_KIT_NOTE_NONE    -1
+#define SAMPLE_KIT_NAME_MAX     64
+
+typedef struct sample_kit {
+    int             num_sample;
+    int             max_sample;     // capacity of the per sample arrays
+    char**          name;
+    char**          path;
+    sample_trig_t** sample;         // sample list, filled by sample_trig_init
+    int*            name_index;     // open addressing table of id + 1, 0 is empty
+    unsigned int    name_index_size;    // power of two, at least twice num_sample
+    int             key_index[256]; // id + 1 per input key, 0 is unmapped
+    int             note_index[SAMPLE_MIDI_NOTE_MAX];   // id + 1 per MIDI note, 0 is unmapped
+
+} sample_kit_t;
+
+int sample_kit_init(sample_kit_t* kit);
+int sample_kit_add(sample_kit_t* kit, const char* name, const char* path, int key, int note);
+int sample_kit_load(sample_kit_t* kit, const char* kit_path);
+int sample_kit_find(const sample_kit_t* kit, const char* name);
+int sample_kit_key(const sample_kit_t* kit, int key);
+int sample_kit_note(const sample_kit_t* kit, int note);
+void sample_kit_deinit(sample_kit_t* kit);
+
+#endif /* SAMPLE_KIT_H */
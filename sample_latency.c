@@ -0,0 +1,123 @@
+#include <string.h>
+#include "sample_latency.h"
+#include "log.h"
+
+#define SAMPLE_LATENCY_SUB_COUNT (1 << SAMPLE_LATENCY_SUB_BITS)
+
+const char* sample_latency_stage_str[SAMPLE_LATENCY_MAX_STAGE] = {
+    [SAMPLE_LATENCY_DEQUEUE] =  "trigger->dequeue",
+    [SAMPLE_LATENCY_WRITE]   =  "trigger->write",
+    [SAMPLE_LATENCY_OUTPUT]  =  "trigger->output",
+};
+
+static unsigned int sample_latency_bucket_index(uint64_t ns) {
+
+    if (ns < SAMPLE_LATENCY_SUB_COUNT) {
+        return ns;
+    }
+
+    int shift = 63 - __builtin_clzll(ns) - SAMPLE_LATENCY_SUB_BITS;
+
+    return ((shift + 1) << SAMPLE_LATENCY_SUB_BITS) + ((ns >> shift) & (SAMPLE_LATENCY_SUB_COUNT - 1));
+}
+
+// Lowest value falling into a bucket
+static uint64_t sample_latency_bucket_value(unsigned int index) {
+
+    if (index < SAMPLE_LATENCY_SUB_COUNT) {
+        return index;
+    }
+
+    int shift = (index >> SAMPLE_LATENCY_SUB_BITS) - 1;
+
+    return (uint64_t)(SAMPLE_LATENCY_SUB_COUNT + (index & (SAMPLE_LATENCY_SUB_COUNT - 1))) << shift;
+}
+
+void sample_latency_hist_reset(sample_latency_hist_t* hist) {
+
+    memset(hist, 0, sizeof(sample_latency_hist_t));
+    hist->min = UINT64_MAX;
+}
+
+void sample_latency_reset(sample_latency_t* latency) {
+
+    int i = 0;
+
+    for (i=0;i<SAMPLE_LATENCY_MAX_STAGE;i++) {
+        sample_latency_hist_reset(&latency->stage[i]);
+    }
+}
+
+void sample_latency_hist_record(sample_latency_hist_t* hist, uint64_t ns) {
+
+    hist->bucket[sample_latency_bucket_index(ns)]++;
+    hist->count++;
+    hist->sum += ns;
+
+    if (ns < hist->min) {
+        hist->min = ns;
+    }
+    if (ns > hist->max) {
+        hist->max = ns;
+    }
+}
+
+void sample_latency_record(sample_latency_t* latency, sample_latency_stage_t stage, uint64_t ns) {
+
+    sample_latency_hist_record(&latency->stage[stage], ns);
+}
+
+// Upper bound of the bucket holding the requested percentile, clamped to the exact max
+uint64_t sample_latency_percentile(const sample_latency_hist_t* hist, double percentile) {
+
+    unsigned int i = 0;
+    uint64_t seen = 0;
+    uint64_t rank = 0;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+
+    rank = (uint64_t)(hist->count * percentile / 100.0);
+    if (rank >= hist->count) {
+        rank = hist->count - 1;
+    }
+
+    for (i=0;i<SAMPLE_LATENCY_BUCKETS;i++) {
+
+        seen += hist->bucket[i];
+        if (seen > rank) {
+
+            uint64_t value = (i + 1 < SAMPLE_LATENCY_BUCKETS) ? sample_latency_bucket_value(i + 1) - 1 : hist->max;
+            return (value < hist->max) ? value : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+void sample_latency_print(sample_latency_t* latency) {
+
+    int i = 0;
+
+    LOG_INFO("Latency report (us):\n");
+
+    for (i=0;i<SAMPLE_LATENCY_MAX_STAGE;i++) {
+
+        sample_latency_hist_t* hist = &latency->stage[i];
+
+        if (hist->count == 0) {
+            LOG_INFO(" %-17s: no sample\n", sample_latency_stage_str[i]);
+            continue;
+        }
+
+        LOG_INFO(" %-17s: count %lu min %.1f avg %.1f p50 %.1f p99 %.1f max %.1f\n",
+                sample_latency_stage_str[i],
+                (unsigned long)hist->count,
+                hist->min / 1000.0,
+                hist->sum / (double)hist->count / 1000.0,
+                sample_latency_percentile(hist, 50.0) / 1000.0,
+                sample_latency_percentile(hist, 99.0) / 1000.0,
+                hist->max / 1000.0);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef SAMPLE_LATENCY_H
+#define SAMPLE_LATENCY_H
+
+#include <stdint.h>
+
+// Log-linear histogram: 2^SUB_BITS linear buckets per power of two, ~6% resolution
+#define SAMPLE_LATENCY_SUB_BITS 4
+#define SAMPLE_LATENCY_BUCKETS  ((64 - SAMPLE_LATENCY_SUB_BITS + 1) << SAMPLE_LATENCY_SUB_BITS)
+
+// Latency is measured from the sample_trig() call to each stage
+typedef enum sample_latency_stage {
+    SAMPLE_LATENCY_DEQUEUE=0,   // engine pulled the trigger from the queue
+    SAMPLE_LATENCY_WRITE,       // first frame handed to the pcm device
+    SAMPLE_LATENCY_OUTPUT,      // first frame estimated at the DAC
+
+    SAMPLE_LATENCY_MAX_STAGE,
+
+} sample_latency_stage_t;
+
+typedef struct sample_latency_hist {
+
+    uint32_t    bucket[SAMPLE_LATENCY_BUCKETS];
+    uint64_t    count;
+    uint64_t    sum;
+    uint64_t    min;
+    uint64_t    max;
+
+} sample_latency_hist_t;
+
+typedef struct sample_latency {
+
+    sample_latency_hist_t stage[SAMPLE_LATENCY_MAX_STAGE];
+
+} sample_latency_t;
+
+void sample_latency_hist_reset(sample_latency_hist_t* hist);
+void sample_latency_hist_record(sample_latency_hist_t* hist, uint64_t ns);
+void sample_latency_reset(sample_latency_t* latency);
+void sample_latency_record(sample_latency_t* latency, sample_latency_stage_t stage, uint64_t ns);
+uint64_t sample_latency_percentile(const sample_latency_hist_t* hist, double percentile);
+void sample_latency_print(sample_latency_t* latency);
+
+#endif /* SAMPLE_LATENCY_H */
@@ -0,0 +1,78 @@
+#include <string.h>
+#include "sample_midi.h"
+
+void sample_midi_init(sample_midi_parser_t* parser) {
+
+    memset(parser, 0, sizeof(sample_midi_parser_t));
+}
+
+// Data bytes following a channel status
+static int sample_midi_data_length(uint8_t status) {
+
+    switch (status & 0xF0) {
+
+        case 0xC0:  // program change
+        case 0xD0:  // channel pressure
+            return 1;
+
+        default:
+            return 2;
+    }
+}
+
+// Parse bytes until they run out or notes is full, *used tells how many bytes were consumed.
+// Returns the number of note-on messages stored, a note-on with velocity 0 is a note-off and skipped.
+int sample_midi_parse(sample_midi_parser_t* parser, const uint8_t* bytes, int count, int* used,
+                      sample_midi_note_t* notes, int max_notes) {
+
+    int i = 0;
+    int num_note = 0;
+
+    for (i=0;i<count && num_note<max_notes;i++) {
+
+        uint8_t byte = bytes[i];
+
+        if (byte >= 0xF8) {
+            // real-time messages may appear anywhere and leave the running status alone
+            continue;
+        }
+
+        if (byte & 0x80) {
+
+            parser->num_data = 0;
+
+            if (byte >= 0xF0) {
+                // system common messages cancel the running status, their data is skipped
+                parser->status = 0;
+                parser->sysex = (byte == 0xF0);
+            } else {
+                parser->status = byte;
+                parser->sysex = 0;
+            }
+            continue;
+        }
+
+        if (parser->status == 0 || parser->sysex) {
+            continue;
+        }
+
+        parser->data[parser->num_data++] = byte;
+
+        if (parser->num_data < sample_midi_data_length(parser->status)) {
+            continue;
+        }
+        parser->num_data = 0;
+
+        if ((parser->status & 0xF0) == 0x90 && parser->data[1] > 0) {
+
+            notes[num_note].channel = parser->status & 0x0F;
+            notes[num_note].note = parser->data[0];
+            notes[num_note].velocity = parser->data[1];
+            num_note++;
+        }
+    }
+
+    *used = i;
+
+    return num_note;
+}
@@ -0,0 +1,30 @@
+#ifndef SAMPLE_MIDI_H
+#define SAMPLE_MIDI_H
+
+#include <stdint.h>
+
+// MIDI byte stream parser: keeps the running status across reads and extracts note-on
+// messages only, into an array given by the caller
+
+#define SAMPLE_MIDI_NOTE_MAX    128
+
+typedef struct sample_midi_parser {
+    uint8_t     status;         // running status, 0 when none
+    uint8_t     data[2];
+    int         num_data;
+    int         sysex;          // inside a system exclusive message
+
+} sample_midi_parser_t;
+
+typedef struct sample_midi_note {
+    uint8_t     channel;
+    uint8_t     note;
+    uint8_t     velocity;
+
+} sample_midi_note_t;
+
+void sample_midi_init(sample_midi_parser_t* parser);
+int sample_midi_parse(sample_midi_parser_t* parser, const uint8_t* bytes, int count, int* used,
+                      sample_midi_note_t* notes, int max_notes);
+
+#endif /* SAMPLE_MIDI_H */
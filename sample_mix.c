@@ -0,0 +1,246 @@
+#include <limits.h>
+#include <string.h>
+#include "sample_mix.h"
+#include "log.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SAMPLE_MIX_X86
+#include <immintrin.h>
+#endif
+
+// Scalar kernel, also used for the tails of the SIMD kernels
+
+static void sample_mix_scalar(int* bus, const short* src, int count, int gain) {
+
+    int i = 0;
+
+    for (i=0;i<count;i++) {
+        bus[i] += (src[i] * gain) >> SAMPLE_MIX_GAIN_SHIFT;
+    }
+}
+
+static void sample_mix_scalar_mono_stereo(int* bus, const short* src, int frames, int gain) {
+
+    int i = 0;
+
+    for (i=0;i<frames;i++) {
+
+        int value = (src[i] * gain) >> SAMPLE_MIX_GAIN_SHIFT;
+        bus[2*i]   += value;
+        bus[2*i+1] += value;
+    }
+}
+
+static void sample_mix_scalar_convert(short* dst, const int* bus, int count) {
+
+    int i = 0;
+
+    for (i=0;i<count;i++) {
+
+        int value = bus[i];
+        if (value > SHRT_MAX) {
+            value = SHRT_MAX;
+        } else if (value < SHRT_MIN) {
+            value = SHRT_MIN;
+        }
+        dst[i] = (short)value;
+    }
+}
+
+static int sample_mix_scalar_supported(void) {
+
+    return 1;
+}
+
+#ifdef SAMPLE_MIX_X86
+
+// SSE2 kernel: 8 values per step, 16x16 bit products widened to 32 bit from their low and high halves
+
+__attribute__((target("sse2")))
+static inline void sample_mix_sse2_product(__m128i src, __m128i gain, __m128i* lo, __m128i* hi) {
+
+    __m128i prod_lo = _mm_mullo_epi16(src, gain);
+    __m128i prod_hi = _mm_mulhi_epi16(src, gain);
+
+    *lo = _mm_srai_epi32(_mm_unpacklo_epi16(prod_lo, prod_hi), SAMPLE_MIX_GAIN_SHIFT);
+    *hi = _mm_srai_epi32(_mm_unpackhi_epi16(prod_lo, prod_hi), SAMPLE_MIX_GAIN_SHIFT);
+}
+
+__attribute__((target("sse2")))
+static void sample_mix_sse2(int* bus, const short* src, int count, int gain) {
+
+    int i = 0;
+    __m128i lo, hi;
+    __m128i vgain = _mm_set1_epi16((short)gain);
+
+    for (i=0;i+8<=count;i+=8) {
+
+        sample_mix_sse2_product(_mm_loadu_si128((const __m128i*)&src[i]), vgain, &lo, &hi);
+
+        _mm_storeu_si128((__m128i*)&bus[i],   _mm_add_epi32(_mm_loadu_si128((__m128i*)&bus[i]),   lo));
+        _mm_storeu_si128((__m128i*)&bus[i+4], _mm_add_epi32(_mm_loadu_si128((__m128i*)&bus[i+4]), hi));
+    }
+
+    sample_mix_scalar(&bus[i], &src[i], count - i, gain);
+}
+
+__attribute__((target("sse2")))
+static void sample_mix_sse2_mono_stereo(int* bus, const short* src, int frames, int gain) {
+
+    int i = 0;
+    __m128i lo, hi;
+    __m128i vgain = _mm_set1_epi16((short)gain);
+
+    for (i=0;i+8<=frames;i+=8) {
+
+        int* out = &bus[2*i];
+
+        sample_mix_sse2_product(_mm_loadu_si128((const __m128i*)&src[i]), vgain, &lo, &hi);
+
+        _mm_storeu_si128((__m128i*)&out[0],  _mm_add_epi32(_mm_loadu_si128((__m128i*)&out[0]),  _mm_unpacklo_epi32(lo, lo)));
+        _mm_storeu_si128((__m128i*)&out[4],  _mm_add_epi32(_mm_loadu_si128((__m128i*)&out[4]),  _mm_unpackhi_epi32(lo, lo)));
+        _mm_storeu_si128((__m128i*)&out[8],  _mm_add_epi32(_mm_loadu_si128((__m128i*)&out[8]),  _mm_unpacklo_epi32(hi, hi)));
+        _mm_storeu_si128((__m128i*)&out[12], _mm_add_epi32(_mm_loadu_si128((__m128i*)&out[12]), _mm_unpackhi_epi32(hi, hi)));
+    }
+
+    sample_mix_scalar_mono_stereo(&bus[2*i], &src[i], frames - i, gain);
+}
+
+__attribute__((target("sse2")))
+static void sample_mix_sse2_convert(short* dst, const int* bus, int count) {
+
+    int i = 0;
+
+    for (i=0;i+8<=count;i+=8) {
+
+        __m128i lo = _mm_loadu_si128((const __m128i*)&bus[i]);
+        __m128i hi = _mm_loadu_si128((const __m128i*)&bus[i+4]);
+
+        _mm_storeu_si128((__m128i*)&dst[i], _mm_packs_epi32(lo, hi));
+    }
+
+    sample_mix_scalar_convert(&dst[i], &bus[i], count - i);
+}
+
+static int sample_mix_sse2_supported(void) {
+
+    return __builtin_cpu_supports("sse2");
+}
+
+// AVX2 kernel: 8 values per step sign extended to 32 bit lanes
+
+__attribute__((target("avx2")))
+static void sample_mix_avx2(int* bus, const short* src, int count, int gain) {
+
+    int i = 0;
+    __m256i vgain = _mm256_set1_epi32(gain);
+
+    for (i=0;i+16<=count;i+=16) {
+
+        __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&src[i]));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&src[i+8]));
+
+        lo = _mm256_srai_epi32(_mm256_mullo_epi32(lo, vgain), SAMPLE_MIX_GAIN_SHIFT);
+        hi = _mm256_srai_epi32(_mm256_mullo_epi32(hi, vgain), SAMPLE_MIX_GAIN_SHIFT);
+
+        _mm256_storeu_si256((__m256i*)&bus[i],   _mm256_add_epi32(_mm256_loadu_si256((__m256i*)&bus[i]),   lo));
+        _mm256_storeu_si256((__m256i*)&bus[i+8], _mm256_add_epi32(_mm256_loadu_si256((__m256i*)&bus[i+8]), hi));
+    }
+
+    sample_mix_scalar(&bus[i], &src[i], count - i, gain);
+}
+
+__attribute__((target("avx2")))
+static void sample_mix_avx2_convert(short* dst, const int* bus, int count) {
+
+    int i = 0;
+
+    for (i=0;i+16<=count;i+=16) {
+
+        __m256i lo = _mm256_loadu_si256((const __m256i*)&bus[i]);
+        __m256i hi = _mm256_loadu_si256((const __m256i*)&bus[i+8]);
+
+        // pack works per 128 bit lane, restore the value order afterwards
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+
+        _mm256_storeu_si256((__m256i*)&dst[i], packed);
+    }
+
+    sample_mix_scalar_convert(&dst[i], &bus[i], count - i);
+}
+
+static int sample_mix_avx2_supported(void) {
+
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif /* SAMPLE_MIX_X86 */
+
+// Ordered from the least to the most preferred kernel
+static const sample_mix_kernel_t sample_mix_kernel[] = {
+    {
+        .name               = "scalar",
+        .mix                = sample_mix_scalar,
+        .mix_mono_stereo    = sample_mix_scalar_mono_stereo,
+        .convert            = sample_mix_scalar_convert,
+        .supported          = sample_mix_scalar_supported,
+    },
+#ifdef SAMPLE_MIX_X86
+    {
+        .name               = "sse2",
+        .mix                = sample_mix_sse2,
+        .mix_mono_stereo    = sample_mix_sse2_mono_stereo,
+        .convert            = sample_mix_sse2_convert,
+        .supported          = sample_mix_sse2_supported,
+    },
+    {
+        .name               = "avx2",
+        .mix                = sample_mix_avx2,
+        .mix_mono_stereo    = sample_mix_sse2_mono_stereo,
+        .convert            = sample_mix_avx2_convert,
+        .supported          = sample_mix_avx2_supported,
+    },
+#endif
+};
+
+int sample_mix_kernel_count(void) {
+
+    return sizeof(sample_mix_kernel) / sizeof(sample_mix_kernel[0]);
+}
+
+const sample_mix_kernel_t* sample_mix_kernel_get(int index) {
+
+    if (index < 0 || index >= sample_mix_kernel_count()) {
+        return NULL;
+    }
+
+    return &sample_mix_kernel[index];
+}
+
+// NULL picks the best kernel the CPU supports
+const sample_mix_kernel_t* sample_mix_select(const char* name) {
+
+    int i = 0;
+
+    for (i=sample_mix_kernel_count()-1;i>=0;i--) {
+
+        const sample_mix_kernel_t* kernel = &sample_mix_kernel[i];
+
+        if (name != NULL && strcmp(name, kernel->name) != 0) {
+            continue;
+        }
+
+        if (!kernel->supported()) {
+            LOG_WARN("Mix kernel %s not supported by this CPU\n", kernel->name);
+            continue;
+        }
+
+        return kernel;
+    }
+
+    if (name != NULL) {
+        LOG_ERROR("Mix kernel '%s' not available\n", name);
+    }
+
+    return NULL;
+}
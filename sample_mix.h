@@ -0,0 +1,30 @@
+#ifndef SAMPLE_MIX_H
+#define SAMPLE_MIX_H
+
+// Voice gain is Q14 so that unity gain fits a signed 16 bit SIMD lane
+#define SAMPLE_MIX_GAIN_SHIFT   14
+#define SAMPLE_MIX_GAIN_UNITY   (1 << SAMPLE_MIX_GAIN_SHIFT)
+
+// Mixing kernels, every implementation is bit exact with the scalar one
+typedef struct sample_mix_kernel {
+
+    const char* name;
+
+    // bus[i] += (src[i] * gain) >> SAMPLE_MIX_GAIN_SHIFT for count values of identical layout
+    void        (*mix)(int* bus, const short* src, int count, int gain);
+
+    // same as mix but every mono frame is summed on both channels of a stereo bus
+    void        (*mix_mono_stereo)(int* bus, const short* src, int frames, int gain);
+
+    // saturate the 32 bit bus into S16 values
+    void        (*convert)(short* dst, const int* bus, int count);
+
+    int         (*supported)(void);
+
+} sample_mix_kernel_t;
+
+const sample_mix_kernel_t* sample_mix_select(const char* name);
+const sample_mix_kernel_t* sample_mix_kernel_get(int index);
+int sample_mix_kernel_count(void);
+
+#endif /* SAMPLE_MIX_H */
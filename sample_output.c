@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sample_output.h"
+#include "log.h"
+
+#ifndef SAMPLE_TRIG_PCM_NAME
+#define SAMPLE_TRIG_PCM_NAME   "default"
+#endif
+
+#define SAMPLE_OUTPUT_WAV_DEFAULT "sample-trig-out.wav"
+
+// ALSA pcm device
+
+static int sample_output_alsa_open(sample_output_t* output, char* target) {
+
+    output->pcm_handle = hal_alsa_pcm_open(target ? target : SAMPLE_TRIG_PCM_NAME, &output->pcm_info);
+    if (output->pcm_handle == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int sample_output_alsa_wait(sample_output_t* output) {
+
+    return hal_alsa_pcm_wait(output->pcm_handle);
+}
+
+static int sample_output_alsa_write(sample_output_t* output, const short* buffer, int frames) {
+
+    return hal_alsa_pcm_write(output->pcm_handle, buffer, frames);
+}
+
+static long int sample_output_alsa_delay(sample_output_t* output) {
+
+    return hal_alsa_pcm_delay(output->pcm_handle);
+}
+
+static int sample_output_alsa_begin(sample_output_t* output, short** buffer, int frames) {
+
+    return hal_alsa_pcm_mmap_begin(output->pcm_handle, (void**)buffer, &output->mmap_offset, frames);
+}
+
+static int sample_output_alsa_commit(sample_output_t* output, int frames) {
+
+    return hal_alsa_pcm_mmap_commit(output->pcm_handle, output->mmap_offset, frames);
+}
+
+static void sample_output_alsa_close(sample_output_t* output) {
+
+    hal_alsa_pcm_close(output->pcm_handle);
+    output->pcm_handle = NULL;
+}
+
+// Null sink
+
+// Sinks without a device accept any period, only the defaults are filled in
+static void sample_output_set_defaults(sample_output_t* output) {
+
+    if (output->pcm_info.rate == 0) {
+        output->pcm_info.rate = SAMPLE_OUTPUT_RATE;
+    }
+    if (output->pcm_info.frames <= 1) {
+        output->pcm_info.frames = SAMPLE_OUTPUT_PERIOD_FRAMES;
+    }
+    output->pcm_info.periods = 1;
+    output->pcm_info.mmap = 0;
+    output->pcm_info.buffer_size = output->pcm_info.frames;
+    output->pcm_info.period = output->pcm_info.frames * 1000000ull / output->pcm_info.rate;
+}
+
+static int sample_output_null_open(sample_output_t* output, char* target) {
+
+    output->pcm_info.name = "null";
+    sample_output_set_defaults(output);
+
+    return 0;
+}
+
+static int sample_output_null_write(sample_output_t* output, const short* buffer, int frames) {
+
+    return 0;
+}
+
+static void sample_output_null_close(sample_output_t* output) {
+
+}
+
+// WAV file sink
+
+static int sample_output_wav_open(sample_output_t* output, char* target) {
+
+    sample_output_set_defaults(output);
+
+    if (hal_sndfile_create_wav(&output->file, target ? target : SAMPLE_OUTPUT_WAV_DEFAULT,
+                               output->pcm_info.rate, output->pcm_info.channel)) {
+        return -1;
+    }
+
+    output->pcm_info.name = output->file.path;
+
+    return 0;
+}
+
+static int sample_output_wav_write(sample_output_t* output, const short* buffer, int frames) {
+
+    if (hal_sndfile_write(&output->file, buffer, frames) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void sample_output_wav_close(sample_output_t* output) {
+
+    hal_sndfile_close(&output->file);
+}
+
+static const sample_output_ops_t sample_output_ops[SAMPLE_OUTPUT_MAX_TYPE] = {
+    [SAMPLE_OUTPUT_ALSA] = {
+        .name   = "alsa",
+        .open   = sample_output_alsa_open,
+        .wait   = sample_output_alsa_wait,
+        .write  = sample_output_alsa_write,
+        .delay  = sample_output_alsa_delay,
+        .begin  = sample_output_alsa_begin,
+        .commit = sample_output_alsa_commit,
+        .close  = sample_output_alsa_close,
+    },
+    [SAMPLE_OUTPUT_NULL] = {
+        .name   = "null",
+        .open   = sample_output_null_open,
+        .write  = sample_output_null_write,
+        .close  = sample_output_null_close,
+    },
+    [SAMPLE_OUTPUT_WAV] = {
+        .name   = "wav",
+        .open   = sample_output_wav_open,
+        .write  = sample_output_wav_write,
+        .close  = sample_output_wav_close,
+    },
+};
+
+// Parse "<backend>[:<target>]", e.g. "alsa:hw:0,0", "null" or "wav:out.wav"
+int sample_output_parse(const char* spec, sample_output_type_t* type, char** target) {
+
+    int i = 0;
+
+    for (i=0;i<SAMPLE_OUTPUT_MAX_TYPE;i++) {
+
+        size_t len = strlen(sample_output_ops[i].name);
+
+        if (strncmp(spec, sample_output_ops[i].name, len) == 0 && (spec[len] == '\0' || spec[len] == ':')) {
+
+            *type = i;
+            *target = (spec[len] == ':') ? (char*)&spec[len+1] : NULL;
+            return 0;
+        }
+    }
+
+    LOG_ERROR("Unknown output backend '%s'\n", spec);
+    return -1;
+}
+
+// pcm_info.channel must be set by the caller, the backend fills rate and period frames.
+// Auto-tune reopens the output from the engine thread, only real-time logging is used here.
+int sample_output_open(sample_output_t* output, sample_output_type_t type, char* target) {
+
+    if (type >= SAMPLE_OUTPUT_MAX_TYPE) {
+        LOG_RT_ERROR("Output backend %d out of range\n", type);
+        return -1;
+    }
+
+    output->ops = &sample_output_ops[type];
+    output->type = type;
+    output->target = target;
+    output->frames_written = 0;
+
+    if (output->ops->open(output, target)) {
+
+        LOG_RT_ERROR("Output %s open failed\n", output->ops->name);
+        output->ops = NULL;
+        return -1;
+    }
+
+    LOG_RT_INFO("Output %s: %s, %u channels, %u Hz, %lu frames x %u periods, output latency %.2f ms\n",
+             output->ops->name, output->pcm_info.name, output->pcm_info.channel,
+             output->pcm_info.rate, output->pcm_info.frames, output->pcm_info.periods,
+             output->pcm_info.buffer_size * 1000.0 / output->pcm_info.rate);
+
+    return 0;
+}
+
+int sample_output_wait(sample_output_t* output) {
+
+    if (output->ops->wait == NULL) {
+        return 0;
+    }
+
+    return output->ops->wait(output);
+}
+
+// Hash every sample written from now on, a render is bit exact with another when hash and frames match
+void sample_output_hash_enable(sample_output_t* output) {
+
+    output->hash_enabled = 1;
+    output->hash = 14695981039346656037ull;
+}
+
+int sample_output_write(sample_output_t* output, const short* buffer, int frames) {
+
+    int i = 0;
+
+    output->frames_written += frames;
+
+    if (output->hash_enabled) {
+
+        for (i=0;i<frames * (int)output->pcm_info.channel;i++) {
+            output->hash = (output->hash ^ (uint16_t)buffer[i]) * 1099511628211ull;
+        }
+    }
+
+    return output->ops->write(output, buffer, frames);
+}
+
+// Frames queued ahead of the output, 0 for sinks which consume periods immediately
+long int sample_output_delay(sample_output_t* output) {
+
+    if (output->ops->delay == NULL) {
+        return 0;
+    }
+
+    return output->ops->delay(output);
+}
+
+// Backend renders straight into the device buffer through begin/commit
+int sample_output_direct(sample_output_t* output) {
+
+    return output->ops->begin != NULL && output->pcm_info.mmap;
+}
+
+// Area to render up to frames frames into, returns the frames available there
+int sample_output_begin(sample_output_t* output, short** buffer, int frames) {
+
+    return output->ops->begin(output, buffer, frames);
+}
+
+int sample_output_commit(sample_output_t* output, int frames) {
+
+    int ret = output->ops->commit(output, frames);
+    if (ret == 0) {
+        output->frames_written += frames;
+    }
+
+    return ret;
+}
+
+// Paced by a device clock, periods have a deadline
+int sample_output_realtime(sample_output_t* output) {
+
+    return output->ops->wait != NULL;
+}
+
+// Close and open the same backend again with another period size, rate and periods are kept
+int sample_output_reopen(sample_output_t* output, unsigned long frames) {
+
+    sample_output_type_t type = output->type;
+    uint64_t frames_written = output->frames_written;
+
+    sample_output_close(output);
+
+    output->pcm_info.frames = frames;
+
+    if (sample_output_open(output, type, output->target)) {
+        return -1;
+    }
+
+    output->frames_written = frames_written;
+
+    return 0;
+}
+
+void sample_output_close(sample_output_t* output) {
+
+    if (output->ops == NULL) {
+        return;
+    }
+
+    output->ops->close(output);
+    output->ops = NULL;
+}
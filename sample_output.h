@@ -0,0 +1,67 @@
+#ifndef SAMPLE_OUTPUT_H
+#define SAMPLE_OUTPUT_H
+
+#include <stdint.h>
+#include "hal_alsa.h"
+#include "hal_sndfile.h"
+
+// Period used by the sinks which have no device clock to negotiate with
+#define SAMPLE_OUTPUT_RATE              44100
+#define SAMPLE_OUTPUT_PERIOD_FRAMES     1024
+
+typedef enum sample_output_type {
+    SAMPLE_OUTPUT_ALSA=0,   // pcm device, paced by the device clock
+    SAMPLE_OUTPUT_NULL,     // discard periods as fast as they are rendered
+    SAMPLE_OUTPUT_WAV,      // write periods to a WAV S16_LE file as fast as they are rendered
+
+    SAMPLE_OUTPUT_MAX_TYPE,
+
+} sample_output_type_t;
+
+typedef struct sample_output sample_output_t;
+
+// Backend operations, wait, delay and direct access (begin/commit) are optional,
+// write and commit return -EPIPE on over/under run
+typedef struct sample_output_ops {
+
+    const char* name;
+    int         (*open)(sample_output_t* output, char* target);
+    int         (*wait)(sample_output_t* output);
+    int         (*write)(sample_output_t* output, const short* buffer, int frames);
+    long int    (*delay)(sample_output_t* output);
+    int         (*begin)(sample_output_t* output, short** buffer, int frames);
+    int         (*commit)(sample_output_t* output, int frames);
+    void        (*close)(sample_output_t* output);
+
+} sample_output_ops_t;
+
+// pcm_info rate, frames and periods hold the request before open and the negotiated values after
+struct sample_output {
+
+    const sample_output_ops_t*  ops;
+    sample_output_type_t        type;
+    char*                       target;
+    pcm_info_t                  pcm_info;
+    snd_pcm_t*                  pcm_handle;
+    snd_pcm_uframes_t           mmap_offset;
+    audio_file_t                file;
+    uint64_t                    frames_written;
+    int                         hash_enabled;
+    uint64_t                    hash;           // FNV-1a of the samples written, to compare renders
+
+};
+
+int sample_output_parse(const char* spec, sample_output_type_t* type, char** target);
+int sample_output_open(sample_output_t* output, sample_output_type_t type, char* target);
+int sample_output_wait(sample_output_t* output);
+int sample_output_write(sample_output_t* output, const short* buffer, int frames);
+void sample_output_hash_enable(sample_output_t* output);
+long int sample_output_delay(sample_output_t* output);
+int sample_output_direct(sample_output_t* output);
+int sample_output_begin(sample_output_t* output, short** buffer, int frames);
+int sample_output_commit(sample_output_t* output, int frames);
+int sample_output_realtime(sample_output_t* output);
+int sample_output_reopen(sample_output_t* output, unsigned long frames);
+void sample_output_close(sample_output_t* output);
+
+#endif /* SAMPLE_OUTPUT_H */
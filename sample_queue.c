@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sample_queue.h"
+#include "log.h"
+
+int sample_queue_init(sample_queue_t* queue, size_t size) {
+
+    size_t i = 0;
+
+    if (size == 0 || (size & (size - 1))) {
+        LOG_ERROR("Sample queue size %zu is not a power of two\n", size);
+        return -1;
+    }
+
+    int ret = posix_memalign((void**)&queue->slot, SAMPLE_QUEUE_CACHE_LINE, size * sizeof(sample_queue_slot_t));
+    if (ret) {
+        LOG_ERROR("Sample queue allocation: %s\n", strerror(ret));
+        queue->slot = NULL;
+        return -1;
+    }
+
+    for (i=0;i<size;i++) {
+        atomic_init(&queue->slot[i].seq, i);
+    }
+
+    queue->mask = size - 1;
+    atomic_init(&queue->head, 0);
+    queue->tail = 0;
+
+    return 0;
+}
+
+void sample_queue_deinit(sample_queue_t* queue) {
+
+    free(queue->slot);
+    queue->slot = NULL;
+}
+
+// Producer side, safe from any number of threads. Returns -1 when the ring is full.
+int sample_queue_push(sample_queue_t* queue, const sample_event_t* event) {
+
+    sample_queue_slot_t* slot = NULL;
+    size_t pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    for (;;) {
+
+        slot = &queue->slot[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+
+        } else if (diff < 0) {
+
+            return -1;
+
+        } else {
+
+            pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+
+    slot->event = *event;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    return 0;
+}
+
+// Push count events with one reservation, all or none. The first slot is published last so the
+// consumer sees the whole batch at once and drains it in a single period. Returns -1 when the ring
+// lacks room for all of them.
+int sample_queue_push_batch(sample_queue_t* queue, const sample_event_t* events, size_t count) {
+
+    size_t i = 0;
+    sample_queue_slot_t* last = NULL;
+    size_t pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    if (count == 0 || count > queue->mask + 1) {
+        return -1;
+    }
+
+    for (;;) {
+
+        // the consumer frees slots in order, the last slot of the batch being free means all of them are
+        last = &queue->slot[(pos + count - 1) & queue->mask];
+        size_t seq = atomic_load_explicit(&last->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + count - 1);
+
+        if (diff == 0) {
+
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &pos, pos + count,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+
+        } else if (diff < 0) {
+
+            return -1;
+
+        } else {
+
+            pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+
+    for (i=0;i<count;i++) {
+        queue->slot[(pos + i) & queue->mask].event = events[i];
+    }
+
+    for (i=count;i>0;i--) {
+        atomic_store_explicit(&queue->slot[(pos + i - 1) & queue->mask].seq, pos + i, memory_order_release);
+    }
+
+    return 0;
+}
+
+// Consumer side, engine thread only. Returns -1 when the ring is empty.
+int sample_queue_pop(sample_queue_t* queue, sample_event_t* event) {
+
+    sample_queue_slot_t* slot = &queue->slot[queue->tail & queue->mask];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    if (seq != queue->tail + 1) {
+        return -1;
+    }
+
+    *event = slot->event;
+    atomic_store_explicit(&slot->seq, queue->tail + queue->mask + 1, memory_order_release);
+    queue->tail++;
+
+    return 0;
+}
+
+// CLOCK_MONOTONIC in nanoseconds, served by the vDSO without a syscall
+uint64_t sample_queue_timestamp(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
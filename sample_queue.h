@@ -0,0 +1,52 @@
+#ifndef SAMPLE_QUEUE_H
+#define SAMPLE_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define SAMPLE_QUEUE_CACHE_LINE 64
+#define SAMPLE_VELOCITY_MAX     127
+
+// Event flags, without any the voice starts on the next period boundary
+#define SAMPLE_EVENT_AT_FRAME       0x01    // start at engine frame clock position 'when'
+#define SAMPLE_EVENT_AT_MONOTONIC   0x02    // start when CLOCK_MONOTONIC 'when' (ns) reaches the output
+#define SAMPLE_EVENT_AT_OFFSET      0x04    // start 'when' frames into the period the event is dequeued for
+
+// Compact trigger event carried from producers to the engine thread
+typedef struct sample_event {
+
+    uint32_t    id;
+    uint8_t     velocity;
+    uint8_t     flags;
+    uint64_t    timestamp;      // CLOCK_MONOTONIC ns of the sample_trig() call
+    uint64_t    when;
+
+} sample_event_t;
+
+typedef struct sample_queue_slot {
+
+    atomic_size_t   seq;
+    sample_event_t  event;
+
+} sample_queue_slot_t;
+
+// Bounded multi-producer single-consumer ring, no lock and no syscall
+typedef struct sample_queue {
+
+    sample_queue_slot_t*    slot;
+    size_t                  mask;
+
+    _Alignas(SAMPLE_QUEUE_CACHE_LINE) atomic_size_t head;
+    _Alignas(SAMPLE_QUEUE_CACHE_LINE) size_t        tail;
+
+} sample_queue_t;
+
+int sample_queue_init(sample_queue_t* queue, size_t size);
+void sample_queue_deinit(sample_queue_t* queue);
+int sample_queue_push(sample_queue_t* queue, const sample_event_t* event);
+int sample_queue_push_batch(sample_queue_t* queue, const sample_event_t* events, size_t count);
+int sample_queue_pop(sample_queue_t* queue, sample_event_t* event);
+uint64_t sample_queue_timestamp(void);
+
+#endif /* SAMPLE_QUEUE_H */
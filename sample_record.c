@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "sample_record.h"
+#include "log.h"
+
+// Append the records waiting in the ring, returns the number written
+static int sample_record_flush(sample_record_t* record) {
+
+    int count = 0;
+    sample_event_t event;
+    sample_record_event_t entry;
+
+    memset(&entry, 0, sizeof(entry));
+
+    while (sample_queue_pop(&record->queue, &event) == 0) {
+
+        entry.frame = event.when;
+        entry.timestamp = event.timestamp;
+        entry.id = event.id;
+        entry.velocity = event.velocity;
+
+        if (record->write_error == 0 && fwrite(&entry, sizeof(entry), 1, record->file) != 1) {
+            LOG_ERROR("Trigger record write: %s\n", strerror(errno));
+            record->write_error = 1;
+        }
+
+        record->header.count++;
+        count++;
+    }
+
+    return count;
+}
+
+static void* sample_record_thread(void* arg) {
+
+    sample_record_t* record = (sample_record_t*)arg;
+    struct timespec poll = {0, SAMPLE_RECORD_POLL_MS * 1000000L};
+
+    while (atomic_load_explicit(&record->run, memory_order_acquire)) {
+
+        if (sample_record_flush(record) == 0) {
+            nanosleep(&poll, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+int sample_record_open(sample_record_t* record, const char* path, uint32_t rate, uint32_t period_frames, uint32_t num_sample) {
+
+    memset(record, 0, sizeof(sample_record_t));
+
+    memcpy(record->header.magic, SAMPLE_RECORD_MAGIC, sizeof(record->header.magic));
+    record->header.version = SAMPLE_RECORD_VERSION;
+    record->header.rate = rate;
+    record->header.period_frames = period_frames;
+    record->header.num_sample = num_sample;
+
+    record->file = fopen(path, "wb");
+    if (record->file == NULL) {
+        LOG_ERROR("Trigger record open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (fwrite(&record->header, sizeof(record->header), 1, record->file) != 1
+        || sample_queue_init(&record->queue, SAMPLE_RECORD_RING_SIZE)) {
+
+        LOG_ERROR("Trigger record %s init failed\n", path);
+        fclose(record->file);
+        record->file = NULL;
+        return -1;
+    }
+
+    atomic_init(&record->dropped, 0);
+    atomic_init(&record->run, 1);
+
+    if (pthread_create(&record->tid, NULL, sample_record_thread, record)) {
+        LOG_ERROR("Trigger record thread creation failed\n");
+        sample_queue_deinit(&record->queue);
+        fclose(record->file);
+        record->file = NULL;
+        return -1;
+    }
+
+    LOG_INFO("Recording triggers to %s\n", path);
+
+    return 0;
+}
+
+// Engine thread: one lock-free push, no I/O
+int sample_record_push(sample_record_t* record, uint32_t id, uint8_t velocity, uint64_t frame, uint64_t timestamp) {
+
+    sample_event_t event;
+
+    event.id = id;
+    event.velocity = velocity;
+    event.flags = SAMPLE_EVENT_AT_FRAME;
+    event.timestamp = timestamp;
+    event.when = frame;
+
+    if (sample_queue_push(&record->queue, &event) < 0) {
+        atomic_fetch_add_explicit(&record->dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Stop the writer once the engine stopped pushing, then complete the header
+int sample_record_close(sample_record_t* record) {
+
+    uint64_t dropped = atomic_load(&record->dropped);
+
+    if (record->file == NULL) {
+        return 0;
+    }
+
+    atomic_store_explicit(&record->run, 0, memory_order_release);
+    pthread_join(record->tid, NULL);
+    sample_record_flush(record);
+
+    if (fseek(record->file, 0, SEEK_SET) || fwrite(&record->header, sizeof(record->header), 1, record->file) != 1) {
+        record->write_error = 1;
+    }
+
+    if (fclose(record->file)) {
+        record->write_error = 1;
+    }
+    record->file = NULL;
+    sample_queue_deinit(&record->queue);
+
+    LOG_INFO("Trigger record: %lu triggers, %lu dropped%s\n", (unsigned long)record->header.count,
+             (unsigned long)dropped, record->write_error ? ", write error" : "");
+
+    return (record->write_error || dropped) ? -1 : 0;
+}
+
+int sample_replay_open(sample_replay_t* replay, const char* path) {
+
+    memset(replay, 0, sizeof(sample_replay_t));
+
+    replay->file = fopen(path, "rb");
+    if (replay->file == NULL) {
+        LOG_ERROR("Trigger replay open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (fread(&replay->header, sizeof(replay->header), 1, replay->file) != 1
+        || memcmp(replay->header.magic, SAMPLE_RECORD_MAGIC, sizeof(replay->header.magic))
+        || replay->header.version != SAMPLE_RECORD_VERSION) {
+
+        LOG_ERROR("Trigger replay %s: not a trigger record\n", path);
+        fclose(replay->file);
+        replay->file = NULL;
+        return -1;
+    }
+
+    LOG_INFO("Trigger replay %s: %lu triggers, %u Hz, %u frame periods, %u samples\n", path,
+             (unsigned long)replay->header.count, replay->header.rate, replay->header.period_frames, replay->header.num_sample);
+
+    return 0;
+}
+
+// Next record in start order, -1 at the end of the log. A log whose header count was never
+// written, the recording process died, is read up to its last complete record.
+int sample_replay_next(sample_replay_t* replay, sample_record_event_t* event) {
+
+    if ((replay->header.count && replay->index >= replay->header.count) || fread(event, sizeof(*event), 1, replay->file) != 1) {
+        return -1;
+    }
+    replay->index++;
+
+    return 0;
+}
+
+void sample_replay_close(sample_replay_t* replay) {
+
+    if (replay->file != NULL) {
+        fclose(replay->file);
+    }
+    memset(replay, 0, sizeof(sample_replay_t));
+}
@@ -0,0 +1,65 @@
+#ifndef SAMPLE_RECORD_H
+#define SAMPLE_RECORD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "sample_queue.h"
+
+// Trigger session log: every voice start of the engine with the frame it started at and the
+// CLOCK_MONOTONIC time of the trigger call. The engine thread pushes records to a lock-free ring,
+// a writer thread appends them to the file. Replaying the frames through the trigger path into an
+// offline output renders the session again sample for sample.
+
+#define SAMPLE_RECORD_MAGIC     "SMPTRREC"
+#define SAMPLE_RECORD_VERSION   1
+#define SAMPLE_RECORD_RING_SIZE 4096
+#define SAMPLE_RECORD_POLL_MS   10
+
+// File header, native endianness like the sample cache
+typedef struct sample_record_header {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    rate;
+    uint32_t    period_frames;  // engine period when the session started
+    uint32_t    num_sample;
+    uint64_t    count;          // records, written when the file is closed
+
+} sample_record_header_t;
+
+typedef struct sample_record_event {
+    uint64_t    frame;          // engine frame clock position of the first frame
+    uint64_t    timestamp;      // CLOCK_MONOTONIC ns of the trigger call, 0 when unknown
+    uint32_t    id;
+    uint8_t     velocity;
+    uint8_t     pad[3];
+
+} sample_record_event_t;
+
+typedef struct sample_record {
+    FILE*                   file;
+    sample_record_header_t  header;
+    sample_queue_t          queue;      // engine thread to writer thread
+    pthread_t               tid;
+    atomic_int              run;
+    atomic_uint_fast64_t    dropped;    // records lost to a full ring, the log is incomplete
+    int                     write_error;
+
+} sample_record_t;
+
+typedef struct sample_replay {
+    FILE*                   file;
+    sample_record_header_t  header;
+    uint64_t                index;
+
+} sample_replay_t;
+
+int sample_record_open(sample_record_t* record, const char* path, uint32_t rate, uint32_t period_frames, uint32_t num_sample);
+int sample_record_push(sample_record_t* record, uint32_t id, uint8_t velocity, uint64_t frame, uint64_t timestamp);
+int sample_record_close(sample_record_t* record);
+
+int sample_replay_open(sample_replay_t* replay, const char* path);
+int sample_replay_next(sample_replay_t* replay, sample_record_event_t* event);
+void sample_replay_close(sample_replay_t* replay);
+
+#endif /* SAMPLE_RECORD_H */
@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "sample_rt.h"
+#include "log.h"
+
+// Parse a cpu list such as "2", "2-3" or "1,4-5"
+static int sample_rt_parse_cpus(const char* cpus, cpu_set_t* set) {
+
+    const char* str = cpus;
+    char* end = NULL;
+
+    CPU_ZERO(set);
+
+    while (*str != '\0') {
+
+        long first = strtol(str, &end, 10);
+        long last = first;
+
+        if (end == str || first < 0) {
+            break;
+        }
+
+        if (*end == '-') {
+            str = end + 1;
+            last = strtol(str, &end, 10);
+            if (end == str || last < first) {
+                break;
+            }
+        }
+
+        for (;first<=last && first<CPU_SETSIZE;first++) {
+            CPU_SET(first, set);
+        }
+
+        if (*end == '\0') {
+            return 0;
+        }
+        if (*end != ',') {
+            break;
+        }
+        str = end + 1;
+    }
+
+    LOG_ERROR("Real-time: invalid cpu list '%s'\n", cpus);
+    return -1;
+}
+
+// Lock current and future pages (sample banks, mappings, stacks) so the audio path never faults
+int sample_rt_lock_memory(sample_rt_t* rt) {
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+
+        LOG_WARN("Real-time: mlockall: %s\n", strerror(errno));
+        rt->memory_locked = 0;
+        return -1;
+    }
+
+    rt->memory_locked = 1;
+
+    return 0;
+}
+
+// Create the thread with SCHED_FIFO and the requested affinity, retry with default attributes when
+// refused. EINVAL may come from the priority or from a cpu set the thread cannot run on, the retry
+// drops both so that real-time mode only ever degrades.
+int sample_rt_thread_create(sample_rt_t* rt, pthread_t* tid, void* (*thread_fct)(void*), void* arg) {
+
+    int ret = 0;
+    cpu_set_t cpu_set;
+    pthread_attr_t attr;
+    struct sched_param param = {0};
+
+    rt->fifo_granted = 0;
+    rt->affinity_granted = 0;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, SAMPLE_RT_STACK_SIZE);
+
+    param.sched_priority = rt->priority ? rt->priority : SAMPLE_RT_PRIORITY_DEFAULT;
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+
+    if (rt->cpus != NULL && sample_rt_parse_cpus(rt->cpus, &cpu_set) == 0) {
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpu_set);
+    }
+
+    ret = pthread_create(tid, &attr, thread_fct, arg);
+    pthread_attr_destroy(&attr);
+
+    if (ret == EPERM || ret == EINVAL) {
+
+        LOG_WARN("Real-time: SCHED_FIFO priority %d%s%s refused: %s, using default scheduling and affinity\n",
+                 param.sched_priority, rt->cpus ? " on cpus " : "", rt->cpus ? rt->cpus : "", strerror(ret));
+
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, SAMPLE_RT_STACK_SIZE);
+        ret = pthread_create(tid, &attr, thread_fct, arg);
+        pthread_attr_destroy(&attr);
+
+        rt->affinity_granted = 0;
+    }
+
+    return ret;
+}
+
+// Touch the top of the stack so the audio loop never takes a fault on it
+void sample_rt_prefault_stack(void) {
+
+    volatile char stack[SAMPLE_RT_STACK_PREFAULT];
+
+    memset((char*)stack, 0, sizeof(stack));
+}
+
+// Report which privileges the audio thread actually got, called from the thread which created it
+void sample_rt_self_check(sample_rt_t* rt, pthread_t tid) {
+
+    int i = 0;
+    int policy = 0;
+    int cpu_count = 0;
+    char cpu_list[256] = {0};
+    size_t len = 0;
+    cpu_set_t cpu_set;
+    cpu_set_t requested;
+    struct sched_param param = {0};
+
+    if (pthread_getschedparam(tid, &policy, &param) == 0) {
+        rt->fifo_granted = (policy == SCHED_FIFO);
+    }
+
+    if (pthread_getaffinity_np(tid, sizeof(cpu_set_t), &cpu_set) == 0) {
+
+        for (i=0;i<CPU_SETSIZE;i++) {
+
+            if (!CPU_ISSET(i, &cpu_set)) {
+                continue;
+            }
+            cpu_count++;
+            if (len < sizeof(cpu_list) - 8) {
+                len += snprintf(&cpu_list[len], sizeof(cpu_list) - len, "%s%d", len ? "," : "", i);
+            }
+        }
+
+        if (rt->cpus != NULL && sample_rt_parse_cpus(rt->cpus, &requested) == 0) {
+            rt->affinity_granted = CPU_EQUAL(&cpu_set, &requested);
+        }
+    }
+
+    LOG_INFO("Real-time self check:\n"
+            " scheduling     : %s priority %d%s\n"
+            " memory locked  : %s\n"
+            " cpu affinity   : %s (%d cpus)%s\n",
+            (policy == SCHED_FIFO) ? "SCHED_FIFO" : (policy == SCHED_RR) ? "SCHED_RR" : "SCHED_OTHER",
+            param.sched_priority,
+            rt->fifo_granted ? "" : " (real-time NOT granted)",
+            rt->memory_locked ? "yes" : "NO",
+            cpu_list, cpu_count,
+            (rt->cpus == NULL) ? "" : rt->affinity_granted ? "" : " (requested affinity NOT granted)");
+}
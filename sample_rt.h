@@ -0,0 +1,27 @@
+#ifndef SAMPLE_RT_H
+#define SAMPLE_RT_H
+
+#include <pthread.h>
+
+#define SAMPLE_RT_PRIORITY_DEFAULT  70
+#define SAMPLE_RT_STACK_SIZE        (256 * 1024)
+#define SAMPLE_RT_STACK_PREFAULT    (64 * 1024)
+
+// Real-time setup of the audio thread, requested and granted privileges
+typedef struct sample_rt {
+
+    int         enable;
+    int         priority;           // SCHED_FIFO priority, 0 selects the default
+    char*       cpus;               // cpu list such as "2" or "2-3,6", NULL keeps the inherited affinity
+    int         memory_locked;
+    int         fifo_granted;
+    int         affinity_granted;
+
+} sample_rt_t;
+
+int sample_rt_lock_memory(sample_rt_t* rt);
+int sample_rt_thread_create(sample_rt_t* rt, pthread_t* tid, void* (*thread_fct)(void*), void* arg);
+void sample_rt_prefault_stack(void);
+void sample_rt_self_check(sample_rt_t* rt, pthread_t tid);
+
+#endif /* SAMPLE_RT_H */
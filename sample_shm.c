@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sample_shm.h"
+#include "log.h"
+
+static size_t sample_shm_map_size(uint32_t size) {
+
+    return sizeof(sample_shm_ring_t) + size * sizeof(sample_shm_slot_t);
+}
+
+static int sample_shm_map(sample_shm_t* shm, int fd, uint32_t size) {
+
+    size_t map_size = sample_shm_map_size(size);
+
+    shm->ring = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm->ring == MAP_FAILED) {
+
+        LOG_ERROR("Trigger shm %s mmap: %s\n", shm->name, strerror(errno));
+        shm->ring = NULL;
+        return -1;
+    }
+    shm->map_size = map_size;
+    shm->size = size;
+
+    return 0;
+}
+
+// Create the ring, a stale object left by a previous engine is replaced
+int sample_shm_create(sample_shm_t* shm, const char* name, uint32_t num_sample, uint32_t rate) {
+
+    uint32_t i = 0;
+    size_t map_size = sample_shm_map_size(SAMPLE_SHM_SIZE);
+
+    memset(shm, 0, sizeof(sample_shm_t));
+    shm->name = strdup(name);
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0660);
+    if (fd < 0) {
+        LOG_ERROR("Trigger shm %s create: %s\n", name, strerror(errno));
+        free(shm->name);
+        shm->name = NULL;
+        return -1;
+    }
+    shm->owner = 1;
+
+    if (ftruncate(fd, map_size) || sample_shm_map(shm, fd, SAMPLE_SHM_SIZE)) {
+
+        LOG_ERROR("Trigger shm %s size: %s\n", name, strerror(errno));
+        close(fd);
+        sample_shm_close(shm);
+        return -1;
+    }
+    close(fd);
+
+    for (i=0;i<SAMPLE_SHM_SIZE;i++) {
+        atomic_init(&shm->ring->slot[i].seq, i);
+    }
+    atomic_init(&shm->ring->frame_clock, 0);
+    atomic_init(&shm->ring->head, 0);
+    atomic_init(&shm->ring->tail, 0);
+    atomic_init(&shm->ring->dropped, 0);
+    shm->ring->size = SAMPLE_SHM_SIZE;
+    shm->ring->slot_size = sizeof(sample_shm_slot_t);
+    shm->ring->num_sample = num_sample;
+    shm->ring->rate = rate;
+    shm->ring->version = SAMPLE_SHM_VERSION;
+
+    // clients check the magic last, the ring is complete once it is visible
+    atomic_thread_fence(memory_order_release);
+    shm->ring->magic = SAMPLE_SHM_MAGIC;
+
+    LOG_INFO("Trigger shm %s: %u slots, %u samples\n", name, SAMPLE_SHM_SIZE, num_sample);
+
+    return 0;
+}
+
+int sample_shm_open(sample_shm_t* shm, const char* name) {
+
+    struct stat file_stat;
+    sample_shm_ring_t header;
+
+    memset(shm, 0, sizeof(sample_shm_t));
+    shm->name = strdup(name);
+
+    int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR("Trigger shm %s open: %s\n", name, strerror(errno));
+        sample_shm_close(shm);
+        return -1;
+    }
+
+    if (fstat(fd, &file_stat) || (size_t)file_stat.st_size < sizeof(sample_shm_ring_t)
+        || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+        || header.magic != SAMPLE_SHM_MAGIC || header.version != SAMPLE_SHM_VERSION
+        || header.slot_size != sizeof(sample_shm_slot_t)
+        || header.size == 0 || (header.size & (header.size - 1))
+        || (size_t)file_stat.st_size < sample_shm_map_size(header.size)) {
+
+        LOG_ERROR("Trigger shm %s: not a compatible trigger ring\n", name);
+        close(fd);
+        sample_shm_close(shm);
+        return -1;
+    }
+
+    if (sample_shm_map(shm, fd, header.size)) {
+        close(fd);
+        sample_shm_close(shm);
+        return -1;
+    }
+    close(fd);
+
+    return 0;
+}
+
+void sample_shm_close(sample_shm_t* shm) {
+
+    if (shm->ring != NULL) {
+        munmap(shm->ring, shm->map_size);
+    }
+
+    if (shm->owner && shm->name != NULL) {
+        shm_unlink(shm->name);
+    }
+
+    free(shm->name);
+    memset(shm, 0, sizeof(sample_shm_t));
+}
+
+// Producer side, any number of threads and processes. Returns -1 when the ring is full.
+int sample_shm_push(sample_shm_t* shm, const sample_event_t* event) {
+
+    sample_shm_ring_t* ring = shm->ring;
+    sample_shm_slot_t* slot = NULL;
+    uint64_t mask = shm->size - 1;
+    uint64_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    for (;;) {
+
+        slot = &ring->slot[pos & mask];
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int64_t diff = (int64_t)(seq - pos);
+
+        if (diff == 0) {
+
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+
+        } else if (diff < 0) {
+
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return -1;
+
+        } else {
+
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+
+    slot->event = *event;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    return 0;
+}
+
+int sample_shm_trig(sample_shm_t* shm, uint32_t id, uint8_t velocity) {
+
+    sample_event_t event = {0};
+
+    event.id = id;
+    event.velocity = velocity;
+    event.timestamp = sample_queue_timestamp();
+
+    return sample_shm_push(shm, &event);
+}
+
+// Engine frame clock as of the last period, base of SAMPLE_EVENT_AT_FRAME triggers
+uint64_t sample_shm_frame_clock(sample_shm_t* shm) {
+
+    return atomic_load_explicit(&shm->ring->frame_clock, memory_order_relaxed);
+}
+
+// Consumer side, one thread only. Returns -1 when the ring is empty.
+int sample_shm_pop(sample_shm_t* shm, sample_event_t* event) {
+
+    sample_shm_ring_t* ring = shm->ring;
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    sample_shm_slot_t* slot = &ring->slot[tail & (shm->size - 1)];
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    if (seq != tail + 1) {
+        return -1;
+    }
+
+    *event = slot->event;
+    atomic_store_explicit(&slot->seq, tail + shm->size, memory_order_release);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_relaxed);
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#ifndef SAMPLE_SHM_H
+#define SAMPLE_SHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "sample_queue.h"
+
+// Cross-process trigger ring in POSIX shared memory.
+//
+// The engine creates the object, external processes map it with sample_shm_open and push
+// sample_event_t records. The layout only holds fixed size integers and offsets, never pointers,
+// so every process may map it at a different address.
+//
+// Protocol, the same bounded MPSC ring as sample_queue:
+//  - slot i starts with seq = i
+//  - a producer reads head, and owns slot head % size once it moves head from pos to pos + 1 with
+//    a CAS while slot seq == pos. It then writes the event and stores seq = pos + 1 (release).
+//  - the consumer reads slot tail % size once seq == tail + 1, then stores seq = tail + size.
+//  - a full ring makes the push fail and counts a drop, nothing blocks. The engine drains the ring
+//    once per period and never sleeps on it, so pushing costs a CAS and a store without any syscall.
+//  - each process indexes slots with the size it mapped, never with the size in the shared header,
+//    so a client writing the header cannot move the engine outside its mapping.
+//  - a producer killed between its CAS and its seq store leaves its slot unpublished: the engine
+//    stops at that slot for the rest of the session and later pushes are dropped once the ring fills.
+//    Clients should not be killed while pushing, restarting the engine recreates the ring.
+
+#define SAMPLE_SHM_NAME         "/sample-trig"
+#define SAMPLE_SHM_MAGIC        0x53485452u     // "SHTR"
+#define SAMPLE_SHM_VERSION      2
+#define SAMPLE_SHM_SIZE         4096            // slots, power of two
+
+typedef struct sample_shm_slot {
+    atomic_uint_fast64_t    seq;
+    sample_event_t          event;
+
+} sample_shm_slot_t;
+
+typedef struct sample_shm_ring {
+    uint32_t                magic;
+    uint32_t                version;
+    uint32_t                size;           // slots
+    uint32_t                slot_size;      // sizeof(sample_shm_slot_t) of the creator
+    uint32_t                num_sample;     // ids 0 to num_sample - 1 are valid
+    uint32_t                rate;           // engine rate, for SAMPLE_EVENT_AT_FRAME timestamps
+    _Alignas(SAMPLE_QUEUE_CACHE_LINE) atomic_uint_fast64_t frame_clock;  // published by the engine every period
+    _Alignas(SAMPLE_QUEUE_CACHE_LINE) atomic_uint_fast64_t head;
+    _Alignas(SAMPLE_QUEUE_CACHE_LINE) atomic_uint_fast64_t tail;
+    _Alignas(SAMPLE_QUEUE_CACHE_LINE) atomic_uint_fast64_t dropped;   // pushes refused by a full ring
+    _Alignas(SAMPLE_QUEUE_CACHE_LINE) sample_shm_slot_t slot[];
+
+} sample_shm_ring_t;
+
+// Mapping of the ring in the calling process
+typedef struct sample_shm {
+    char*               name;
+    int                 owner;          // created the object, unlinks it on close
+    size_t              map_size;
+    uint32_t            size;           // slots mapped, checked at create or open
+    sample_shm_ring_t*  ring;
+
+} sample_shm_t;
+
+// Engine side
+int sample_shm_create(sample_shm_t* shm, const char* name, uint32_t num_sample, uint32_t rate);
+int sample_shm_pop(sample_shm_t* shm, sample_event_t* event);
+
+// Client side
+int sample_shm_open(sample_shm_t* shm, const char* name);
+int sample_shm_push(sample_shm_t* shm, const sample_event_t* event);
+int sample_shm_trig(sample_shm_t* shm, uint32_t id, uint8_t velocity);
+uint64_t sample_shm_frame_clock(sample_shm_t* shm);
+
+void sample_shm_close(sample_shm_t* shm);
+
+#endif /* SAMPLE_SHM_H */
@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <limits.h>
+#include "sample_src.h"
+#include "hal_sndfile.h"
+#include "log.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SAMPLE_SRC_X86
+#include <immintrin.h>
+#endif
+
+typedef float (*sample_src_dot_t)(const float* signal, const float* taps, int num_taps);
+
+static float sample_src_dot_scalar(const float* signal, const float* taps, int num_taps) {
+
+    int i = 0;
+    float acc = 0;
+
+    for (i=0;i<num_taps;i++) {
+        acc += signal[i] * taps[i];
+    }
+
+    return acc;
+}
+
+#ifdef SAMPLE_SRC_X86
+
+// Taps rows are aligned and a multiple of 4 long, the signal may start anywhere
+__attribute__((target("sse")))
+static float sample_src_dot_sse(const float* signal, const float* taps, int num_taps) {
+
+    int i = 0;
+    float sum[4];
+    __m128 acc = _mm_setzero_ps();
+
+    for (i=0;i<num_taps;i+=4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&signal[i]), _mm_load_ps(&taps[i])));
+    }
+
+    _mm_storeu_ps(sum, acc);
+
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+#endif
+
+static sample_src_dot_t sample_src_select_dot(void) {
+
+#ifdef SAMPLE_SRC_X86
+    if (__builtin_cpu_supports("sse")) {
+        return sample_src_dot_sse;
+    }
+#endif
+
+    return sample_src_dot_scalar;
+}
+
+static long int sample_src_gcd(long int a, long int b) {
+
+    while (b != 0) {
+        long int t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+// Windowed sinc for every phase, each row normalised to unity DC gain
+static float* sample_src_build_table(int num_phases, int num_taps, double cutoff) {
+
+    int p = 0;
+    int k = 0;
+    float* table = NULL;
+    double half = num_taps / 2.0;
+
+    if (posix_memalign((void**)&table, HAL_SNDFILE_BUFFER_ALIGN, (size_t)num_phases * num_taps * sizeof(float))) {
+        return NULL;
+    }
+
+    for (p=0;p<num_phases;p++) {
+
+        double sum = 0;
+        double frac = (double)p / num_phases;
+        float* row = &table[p * num_taps];
+
+        for (k=0;k<num_taps;k++) {
+
+            // distance in input samples between the tap and the output position
+            double x = k - half + 1 - frac;
+            double sinc = (x == 0) ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            double w = x / half;
+            double window = (fabs(w) >= 1.0) ? 0.0 : 0.42 + 0.5 * cos(M_PI * w) + 0.08 * cos(2 * M_PI * w);
+
+            row[k] = cutoff * sinc * window;
+            sum += row[k];
+        }
+
+        for (k=0;k<num_taps;k++) {
+            row[k] /= sum;
+        }
+    }
+
+    return table;
+}
+
+// Convert interleaved S16 frames from in_rate to out_rate, the output is allocated aligned
+int sample_src_convert(const short* in, long int in_frames, int channels, int in_rate, int out_rate,
+                       short** out, long int* out_frames) {
+
+    int ch = 0;
+    long int i = 0;
+    long int n = 0;
+    long int gcd = sample_src_gcd(in_rate, out_rate);
+    long int up = out_rate / gcd;
+    long int down = in_rate / gcd;
+    int num_phases = (up <= SAMPLE_SRC_PHASES_MAX) ? up : SAMPLE_SRC_PHASES_MAX;
+    double cutoff = ((out_rate < in_rate) ? (double)out_rate / in_rate : 1.0) * SAMPLE_SRC_ROLLOFF;
+    int num_taps = (int)ceil(SAMPLE_SRC_TAPS / cutoff);
+    sample_src_dot_t dot = sample_src_select_dot();
+
+    num_taps = (num_taps + 3) & ~3;
+
+    float* table = sample_src_build_table(num_phases, num_taps, cutoff);
+    long int padded = in_frames + 2 * num_taps;
+    float* planar = calloc((size_t)padded * channels, sizeof(float));
+    long int frame_count = (in_frames * up + down - 1) / down;
+    short* pcm = NULL;
+
+    if (table == NULL || planar == NULL
+        || posix_memalign((void**)&pcm, HAL_SNDFILE_BUFFER_ALIGN, (size_t)frame_count * channels * sizeof(short))) {
+
+        LOG_ERROR("Sample rate conversion allocation failed\n");
+        free(table);
+        free(planar);
+        return -1;
+    }
+
+    // one zero padded float plane per channel so every tap window is contiguous
+    for (ch=0;ch<channels;ch++) {
+
+        float* plane = &planar[ch * padded + num_taps];
+
+        for (i=0;i<in_frames;i++) {
+            plane[i] = in[i * channels + ch];
+        }
+    }
+
+    for (n=0;n<frame_count;n++) {
+
+        uint64_t position = (uint64_t)n * down;
+        long int index = position / up;
+        long int phase = position % up;
+        const float* taps = &table[(phase * num_phases / up) * num_taps];
+
+        for (ch=0;ch<channels;ch++) {
+
+            const float* signal = &planar[ch * padded + num_taps + index - num_taps / 2 + 1];
+            long int value = lrintf(dot(signal, taps, num_taps));
+
+            if (value > SHRT_MAX) {
+                value = SHRT_MAX;
+            } else if (value < SHRT_MIN) {
+                value = SHRT_MIN;
+            }
+            pcm[n * channels + ch] = (short)value;
+        }
+    }
+
+    free(table);
+    free(planar);
+
+    *out = pcm;
+    *out_frames = frame_count;
+
+    return 0;
+}
@@ -0,0 +1,13 @@
+#ifndef SAMPLE_SRC_H
+#define SAMPLE_SRC_H
+
+// Load time sample rate conversion with a windowed sinc polyphase filter
+
+#define SAMPLE_SRC_TAPS         32      // taps per phase at unity ratio, more when decimating
+#define SAMPLE_SRC_PHASES_MAX   1024    // ratios needing more phases use the nearest phase
+#define SAMPLE_SRC_ROLLOFF      0.92    // cutoff relative to the lower Nyquist frequency
+
+int sample_src_convert(const short* in, long int in_frames, int channels, int in_rate, int out_rate,
+                       short** out, long int* out_frames);
+
+#endif /* SAMPLE_SRC_H */
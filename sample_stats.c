@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sample_stats.h"
+#include "log.h"
+
+// Create the block, a stale object left by a previous engine is replaced
+int sample_stats_create(sample_stats_t* stats, const char* name, const char* output) {
+
+    sample_stats_block_t* block = NULL;
+
+    memset(stats, 0, sizeof(sample_stats_t));
+    stats->name = strdup(name);
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("Stats shm %s create: %s\n", name, strerror(errno));
+        free(stats->name);
+        stats->name = NULL;
+        return -1;
+    }
+    stats->owner = 1;
+
+    if (ftruncate(fd, sizeof(sample_stats_block_t))) {
+        LOG_ERROR("Stats shm %s size: %s\n", name, strerror(errno));
+        close(fd);
+        sample_stats_close(stats);
+        return -1;
+    }
+
+    block = mmap(NULL, sizeof(sample_stats_block_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (block == MAP_FAILED) {
+        LOG_ERROR("Stats shm %s mmap: %s\n", name, strerror(errno));
+        sample_stats_close(stats);
+        return -1;
+    }
+    stats->block = block;
+
+    // ftruncate zeroed the counters, only the histogram minimums and the identity are set
+    sample_latency_hist_reset(&block->render);
+    sample_latency_hist_reset(&block->wait);
+    snprintf(block->output, sizeof(block->output), "%s", output);
+    block->pid = getpid();
+    block->size = sizeof(sample_stats_block_t);
+    block->version = SAMPLE_STATS_VERSION;
+
+    atomic_thread_fence(memory_order_release);
+    block->magic = SAMPLE_STATS_MAGIC;
+
+    return 0;
+}
+
+// Map the block of a running engine read-only
+int sample_stats_open(sample_stats_t* stats, const char* name) {
+
+    struct stat file_stat;
+    sample_stats_block_t* block = NULL;
+
+    memset(stats, 0, sizeof(sample_stats_t));
+
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR("Stats shm %s open: %s\n", name, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(fd, &file_stat) || (size_t)file_stat.st_size < sizeof(sample_stats_block_t)) {
+        LOG_ERROR("Stats shm %s: not a stats block\n", name);
+        close(fd);
+        return -1;
+    }
+
+    block = mmap(NULL, sizeof(sample_stats_block_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (block == MAP_FAILED) {
+        LOG_ERROR("Stats shm %s mmap: %s\n", name, strerror(errno));
+        return -1;
+    }
+
+    if (block->magic != SAMPLE_STATS_MAGIC || block->version != SAMPLE_STATS_VERSION
+        || block->size != sizeof(sample_stats_block_t)) {
+
+        LOG_ERROR("Stats shm %s: incompatible stats block\n", name);
+        munmap(block, sizeof(sample_stats_block_t));
+        return -1;
+    }
+
+    stats->name = strdup(name);
+    stats->block = block;
+
+    return 0;
+}
+
+void sample_stats_print(const sample_stats_block_t* block) {
+
+    uint64_t periods = atomic_load_explicit(&block->periods, memory_order_relaxed);
+    uint64_t budget = atomic_load_explicit(&block->budget_ns, memory_order_relaxed);
+
+    LOG_INFO("%s: %lu periods of %lu frames, %lu xruns, %lu deadline misses, render p50 %.1f p99 %.1f max %.1f / %.1f us, "
+             "wait avg %.1f us, voices %lu (high %lu, %lu stolen), triggers %lu (%lu late, %lu dropped, %lu rejected), queue high %lu\n",
+             block->output, (unsigned long)periods,
+             (unsigned long)atomic_load_explicit(&block->period_frames, memory_order_relaxed),
+             (unsigned long)atomic_load_explicit(&block->xruns, memory_order_relaxed),
+             (unsigned long)atomic_load_explicit(&block->deadline_miss, memory_order_relaxed),
+             sample_latency_percentile(&block->render, 50.0) / 1000.0,
+             sample_latency_percentile(&block->render, 99.0) / 1000.0,
+             block->render.count ? block->render.max / 1000.0 : 0.0,
+             budget / 1000.0,
+             periods ? atomic_load_explicit(&block->wait_ns, memory_order_relaxed) / (double)periods / 1000.0 : 0.0,
+             (unsigned long)atomic_load_explicit(&block->voices_active, memory_order_relaxed),
+             (unsigned long)atomic_load_explicit(&block->voices_high, memory_order_relaxed),
+             (unsigned long)atomic_load_explicit(&block->voices_stolen, memory_order_relaxed),
+             (unsigned long)atomic_load_explicit(&block->triggers, memory_order_relaxed),
+             (unsigned long)atomic_load_explicit(&block->triggers_late, memory_order_relaxed),
+             (unsigned long)atomic_load_explicit(&block->triggers_dropped, memory_order_relaxed),
+             (unsigned long)atomic_load_explicit(&block->triggers_rejected, memory_order_relaxed),
+             (unsigned long)atomic_load_explicit(&block->queue_high, memory_order_relaxed));
+}
+
+void sample_stats_close(sample_stats_t* stats) {
+
+    if (stats->block != NULL) {
+        munmap(stats->block, sizeof(sample_stats_block_t));
+    }
+
+    if (stats->owner && stats->name != NULL) {
+        shm_unlink(stats->name);
+    }
+
+    free(stats->name);
+    memset(stats, 0, sizeof(sample_stats_t));
+}
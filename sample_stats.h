@@ -0,0 +1,60 @@
+#ifndef SAMPLE_STATS_H
+#define SAMPLE_STATS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include "sample_latency.h"
+
+// Runtime metrics block in POSIX shared memory, polled by external tools (see sample-trigger -W).
+//
+// The engine thread is the only writer: it updates the block once per period with relaxed stores
+// and plain histogram increments, never formats anything and never blocks. Readers map the block
+// read-only and may see counters of one poll up to a period apart, each field is read whole.
+// The object lives in tmpfs, so unlike a mapped regular file no writeback can fault the audio thread.
+
+#define SAMPLE_STATS_MAGIC      0x53545453u     // "STTS"
+#define SAMPLE_STATS_VERSION    1
+#define SAMPLE_STATS_NAME_MAX   64
+
+typedef struct sample_stats_block {
+    uint32_t                magic;
+    uint32_t                version;
+    uint32_t                size;           // sizeof(sample_stats_block_t) of the writer
+    pid_t                   pid;            // engine process, gone once the engine exited
+    char                    output[SAMPLE_STATS_NAME_MAX];  // output backend and target
+
+    atomic_uint_fast64_t    rate;
+    atomic_uint_fast64_t    period_frames;  // follows auto-tune
+    atomic_uint_fast64_t    budget_ns;      // period duration, render time must stay below it
+    atomic_uint_fast64_t    periods;
+    atomic_uint_fast64_t    frames;
+    atomic_uint_fast64_t    xruns;          // over/under runs of the output device
+    atomic_uint_fast64_t    deadline_miss;  // periods rendered in more than their budget
+    atomic_uint_fast64_t    voices_active;
+    atomic_uint_fast64_t    voices_high;    // high-water mark of active voices
+    atomic_uint_fast64_t    voices_stolen;
+    atomic_uint_fast64_t    triggers;       // events dequeued by the engine
+    atomic_uint_fast64_t    triggers_late;  // scheduled triggers dequeued after their frame
+    atomic_uint_fast64_t    triggers_dropped;   // refused by a full trigger queue or shared ring
+    atomic_uint_fast64_t    triggers_rejected;  // shared ring events with an invalid id or flags
+    atomic_uint_fast64_t    queue_high;     // high-water mark of events drained in one period
+    atomic_uint_fast64_t    wait_ns;        // total time blocked waiting for the output device
+    sample_latency_hist_t   render;         // ns spent rendering each period
+    sample_latency_hist_t   wait;           // ns blocked waiting for the output device each period
+
+} sample_stats_block_t;
+
+typedef struct sample_stats {
+    char*                   name;
+    int                     owner;          // created the object, unlinks it on close
+    sample_stats_block_t*   block;
+
+} sample_stats_t;
+
+int sample_stats_create(sample_stats_t* stats, const char* name, const char* output);
+int sample_stats_open(sample_stats_t* stats, const char* name);
+void sample_stats_print(const sample_stats_block_t* block);
+void sample_stats_close(sample_stats_t* stats);
+
+#endif /* SAMPLE_STATS_H */
@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "sample_stream.h"
+#include "log.h"
+
+static void sample_stream_close(sample_stream_t* stream) {
+
+    if (stream->file.handler != NULL || stream->file.buffer != NULL) {
+        hal_sndfile_close(&stream->file);
+    }
+    memset(&stream->file, 0, sizeof(audio_file_t));
+}
+
+// Open the file of a claimed slot and seek past the resident head
+static int sample_stream_open(sample_streamer_t* streamer, sample_stream_t* stream) {
+
+    sample_buffer_t* buffer = stream->buffer;
+
+    if (hal_sndfile_open_stream(&stream->file, buffer->path, SAMPLE_STREAM_CHUNK_FRAMES)) {
+        return -1;
+    }
+
+    if (stream->file.info.channels != buffer->stream_channels) {
+
+        LOG_ERROR("Sample stream %s: file changed while playing\n", buffer->path);
+        return -1;
+    }
+
+    hal_sndfile_set_clipping(&stream->file);
+
+    return hal_sndfile_seek(&stream->file, buffer->num_frames);
+}
+
+// Top the ring up from the file, converting the file channels to the output ones
+static void sample_stream_fill(sample_streamer_t* streamer, sample_stream_t* stream) {
+
+    int in_channels = stream->buffer->stream_channels;
+    uint64_t write_pos = atomic_load_explicit(&stream->write_pos, memory_order_relaxed);
+    uint64_t read_pos = atomic_load_explicit(&stream->read_pos, memory_order_acquire);
+    unsigned long space = streamer->ring_frames - (write_pos - read_pos);
+
+    while (space > 0 && atomic_load_explicit(&stream->eof, memory_order_relaxed) == 0) {
+
+        unsigned long index = write_pos % streamer->ring_frames;
+        unsigned long count = streamer->ring_frames - index;
+        short* dst = &stream->ring[index * streamer->channels];
+
+        if (count > space) {
+            count = space;
+        }
+        if (count > SAMPLE_STREAM_CHUNK_FRAMES) {
+            count = SAMPLE_STREAM_CHUNK_FRAMES;
+        }
+
+        long int frame_count = hal_sndfile_read(&stream->file, count);
+        if (frame_count < 0) {
+
+            LOG_ERROR("Sample stream %s: read failure\n", stream->buffer->path);
+            atomic_fetch_add_explicit(&streamer->read_errors, 1, memory_order_relaxed);
+            frame_count = 0;
+        }
+
+        if (in_channels == streamer->channels) {
+            memcpy(dst, stream->file.buffer, frame_count * in_channels * sizeof(short));
+        } else {
+            sample_bank_mix_channels(dst, streamer->channels, stream->file.buffer, in_channels, frame_count);
+        }
+
+        write_pos += frame_count;
+        space -= frame_count;
+        atomic_store_explicit(&stream->write_pos, write_pos, memory_order_release);
+
+        if ((unsigned long)frame_count < count) {
+            atomic_store_explicit(&stream->eof, 1, memory_order_release);
+        }
+    }
+}
+
+static void* sample_stream_thread(void* arg) {
+
+    int i = 0;
+    struct timespec timeout;
+    sample_streamer_t* streamer = (sample_streamer_t*)arg;
+
+    LOG_INFO("Sample stream thread: %d slots, %lu frames read-ahead\n", streamer->num_stream, streamer->ring_frames);
+
+    while (atomic_load_explicit(&streamer->run, memory_order_acquire)) {
+
+        for (i=0;i<streamer->num_stream;i++) {
+
+            sample_stream_t* stream = &streamer->stream[i];
+            int state = atomic_load_explicit(&stream->state, memory_order_acquire);
+
+            if (state == SAMPLE_STREAM_START) {
+
+                if (sample_stream_open(streamer, stream)) {
+
+                    atomic_fetch_add_explicit(&streamer->read_errors, 1, memory_order_relaxed);
+                    atomic_store_explicit(&stream->eof, 1, memory_order_release);
+                }
+
+                // the voice may already be gone, the slot is then released right away
+                if (atomic_compare_exchange_strong(&stream->state, &state, SAMPLE_STREAM_RUN) == 0) {
+                    state = SAMPLE_STREAM_STOP;
+                } else {
+                    state = SAMPLE_STREAM_RUN;
+                }
+            }
+
+            if (state == SAMPLE_STREAM_RUN) {
+                sample_stream_fill(streamer, stream);
+            }
+
+            if (state == SAMPLE_STREAM_STOP) {
+
+                sample_stream_close(stream);
+                atomic_store_explicit(&stream->state, SAMPLE_STREAM_FREE, memory_order_release);
+            }
+        }
+
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_nsec += SAMPLE_STREAM_POLL_NS;
+        if (timeout.tv_nsec >= 1000000000) {
+            timeout.tv_sec++;
+            timeout.tv_nsec -= 1000000000;
+        }
+        while (sem_timedwait(&streamer->wake, &timeout) && errno == EINTR);
+    }
+
+    return NULL;
+}
+
+int sample_stream_init(sample_streamer_t* streamer, int num_stream, int channels, unsigned long ring_frames) {
+
+    int i = 0;
+    size_t ring_size = ring_frames * channels * sizeof(short);
+
+    memset(streamer, 0, sizeof(sample_streamer_t));
+    streamer->num_stream = num_stream;
+    streamer->channels = channels;
+    streamer->ring_frames = ring_frames;
+
+    streamer->stream = calloc(num_stream, sizeof(sample_stream_t));
+    if (streamer->stream == NULL
+        || posix_memalign((void**)&streamer->ring_memory, HAL_SNDFILE_BUFFER_ALIGN, ring_size * num_stream)) {
+
+        LOG_ERROR("Sample stream: allocate %d rings of %lu frames\n", num_stream, ring_frames);
+        free(streamer->stream);
+        streamer->stream = NULL;
+        streamer->ring_memory = NULL;
+        return -1;
+    }
+
+    // touch the rings now, the audio thread reads them
+    memset(streamer->ring_memory, 0, ring_size * num_stream);
+
+    for (i=0;i<num_stream;i++) {
+        streamer->stream[i].ring = streamer->ring_memory + i * ring_frames * channels;
+    }
+
+    sem_init(&streamer->wake, 0, 0);
+    atomic_store(&streamer->run, 1);
+
+    if (pthread_create(&streamer->tid, NULL, sample_stream_thread, streamer)) {
+
+        LOG_ERROR("Sample stream thread create: %s\n", strerror(errno));
+        sem_destroy(&streamer->wake);
+        free(streamer->stream);
+        free(streamer->ring_memory);
+        memset(streamer, 0, sizeof(sample_streamer_t));
+        return -1;
+    }
+
+    return 0;
+}
+
+void sample_stream_deinit(sample_streamer_t* streamer) {
+
+    int i = 0;
+
+    if (streamer->stream == NULL) {
+        return;
+    }
+
+    atomic_store(&streamer->run, 0);
+    sem_post(&streamer->wake);
+    pthread_join(streamer->tid, NULL);
+
+    for (i=0;i<streamer->num_stream;i++) {
+        sample_stream_close(&streamer->stream[i]);
+    }
+
+    sem_destroy(&streamer->wake);
+    free(streamer->stream);
+    free(streamer->ring_memory);
+    memset(streamer, 0, sizeof(sample_streamer_t));
+}
+
+void sample_stream_print(sample_streamer_t* streamer) {
+
+    LOG_INFO("Sample stream: %lu underflows (%lu frames), %lu voices without slot, %lu read errors\n",
+             (unsigned long)atomic_load(&streamer->underflows),
+             (unsigned long)atomic_load(&streamer->underflow_frames),
+             (unsigned long)atomic_load(&streamer->no_slot),
+             (unsigned long)atomic_load(&streamer->read_errors));
+}
+
+// Claim a free slot for a voice of a streamed sample, NULL when all slots play
+sample_stream_t* sample_stream_start(sample_streamer_t* streamer, sample_buffer_t* buffer) {
+
+    int i = 0;
+
+    for (i=0;i<streamer->num_stream;i++) {
+
+        sample_stream_t* stream = &streamer->stream[i];
+
+        // only the audio thread moves a slot out of FREE
+        if (atomic_load_explicit(&stream->state, memory_order_acquire) != SAMPLE_STREAM_FREE) {
+            continue;
+        }
+
+        stream->buffer = buffer;
+        atomic_store_explicit(&stream->write_pos, 0, memory_order_relaxed);
+        atomic_store_explicit(&stream->read_pos, 0, memory_order_relaxed);
+        atomic_store_explicit(&stream->eof, 0, memory_order_relaxed);
+        atomic_store_explicit(&stream->state, SAMPLE_STREAM_START, memory_order_release);
+        sem_post(&streamer->wake);
+
+        return stream;
+    }
+
+    atomic_fetch_add_explicit(&streamer->no_slot, 1, memory_order_relaxed);
+
+    return NULL;
+}
+
+void sample_stream_stop(sample_streamer_t* streamer, sample_stream_t* stream) {
+
+    atomic_store_explicit(&stream->state, SAMPLE_STREAM_STOP, memory_order_release);
+    sem_post(&streamer->wake);
+}
+
+// Contiguous frames ready in the ring, -1 once the file is exhausted and the ring drained
+long int sample_stream_peek(sample_streamer_t* streamer, sample_stream_t* stream, const short** frames) {
+
+    int eof = atomic_load_explicit(&stream->eof, memory_order_acquire);
+    uint64_t write_pos = atomic_load_explicit(&stream->write_pos, memory_order_acquire);
+    uint64_t read_pos = atomic_load_explicit(&stream->read_pos, memory_order_relaxed);
+    unsigned long index = read_pos % streamer->ring_frames;
+    unsigned long count = write_pos - read_pos;
+
+    if (count == 0) {
+        return eof ? -1 : 0;
+    }
+
+    if (count > streamer->ring_frames - index) {
+        count = streamer->ring_frames - index;
+    }
+
+    *frames = &stream->ring[index * streamer->channels];
+
+    return count;
+}
+
+// The ring holds num_frames ahead of the read position, or everything left of the file
+int sample_stream_ready(sample_streamer_t* streamer, sample_stream_t* stream, long int num_frames) {
+
+    int eof = atomic_load_explicit(&stream->eof, memory_order_acquire);
+    uint64_t write_pos = atomic_load_explicit(&stream->write_pos, memory_order_acquire);
+    uint64_t read_pos = atomic_load_explicit(&stream->read_pos, memory_order_relaxed);
+
+    return eof || write_pos - read_pos >= (uint64_t)num_frames;
+}
+
+void sample_stream_consume(sample_streamer_t* streamer, sample_stream_t* stream, long int num_frames) {
+
+    uint64_t read_pos = atomic_load_explicit(&stream->read_pos, memory_order_relaxed);
+
+    atomic_store_explicit(&stream->read_pos, read_pos + num_frames, memory_order_release);
+}
+
+// Ask the I/O thread for a refill pass, once per period with streamed voices playing
+void sample_stream_kick(sample_streamer_t* streamer) {
+
+    sem_post(&streamer->wake);
+}
@@ -0,0 +1,69 @@
+#ifndef SAMPLE_STREAM_H
+#define SAMPLE_STREAM_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "hal_sndfile.h"
+#include "sample_bank.h"
+
+// Disk streaming of long samples: the head stays resident in the bank, an I/O thread refills
+// one ring per playing voice with the frames following it. The audio thread only moves ring
+// positions and never waits on the I/O thread.
+
+#define SAMPLE_STREAM_SLOTS         16      // streamed voices playing at once
+#define SAMPLE_STREAM_HEAD_MS       500     // resident head, covers the file open and first read
+#define SAMPLE_STREAM_AHEAD_MS      1000    // read-ahead depth of each ring
+#define SAMPLE_STREAM_CHUNK_FRAMES  4096    // frames per file read
+#define SAMPLE_STREAM_POLL_NS       5000000 // refill poll when no wake up is posted
+
+typedef enum sample_stream_state {
+    SAMPLE_STREAM_FREE=0,
+    SAMPLE_STREAM_START,    // claimed by the audio thread, the I/O thread opens the file
+    SAMPLE_STREAM_RUN,      // the I/O thread keeps the ring filled
+    SAMPLE_STREAM_STOP,     // released by the audio thread, the I/O thread closes the file
+
+} sample_stream_state_t;
+
+// Single producer (I/O thread) single consumer (audio thread) ring of output frames
+typedef struct sample_stream {
+    atomic_int              state;
+    atomic_int              eof;
+    atomic_uint_fast64_t    write_pos;  // frames produced since the end of the head
+    atomic_uint_fast64_t    read_pos;   // frames consumed since the end of the head
+    sample_buffer_t*        buffer;     // streamed sample, set by the audio thread before START
+    short*                  ring;
+    audio_file_t            file;       // I/O thread only
+
+} sample_stream_t;
+
+typedef struct sample_streamer {
+    pthread_t               tid;
+    atomic_int              run;
+    sem_t                   wake;
+    sample_stream_t*        stream;
+    int                     num_stream;
+    int                     channels;       // output channels stored in the rings
+    unsigned long           ring_frames;
+    short*                  ring_memory;
+    atomic_uint_fast64_t    underflows;     // mixes that found the ring short of frames
+    atomic_uint_fast64_t    underflow_frames;
+    atomic_uint_fast64_t    no_slot;        // streamed voices cut at the end of their head
+    atomic_uint_fast64_t    read_errors;
+
+} sample_streamer_t;
+
+int sample_stream_init(sample_streamer_t* streamer, int num_stream, int channels, unsigned long ring_frames);
+void sample_stream_deinit(sample_streamer_t* streamer);
+void sample_stream_print(sample_streamer_t* streamer);
+
+// Audio thread side, never blocking
+sample_stream_t* sample_stream_start(sample_streamer_t* streamer, sample_buffer_t* buffer);
+void sample_stream_stop(sample_streamer_t* streamer, sample_stream_t* stream);
+long int sample_stream_peek(sample_streamer_t* streamer, sample_stream_t* stream, const short** frames);
+int sample_stream_ready(sample_streamer_t* streamer, sample_stream_t* stream, long int num_frames);
+void sample_stream_consume(sample_streamer_t* streamer, sample_stream_t* stream, long int num_frames);
+void sample_stream_kick(sample_streamer_t* streamer);
+
+#endif /* SAMPLE_STREAM_H */
@@ -2,7 +2,19 @@
 #include "log.h"
 
 #define SAMPLE_TRIG_MQEUE_NAME "/trigger"
-#define SAMPLE_TRIG_PCM_NAME   "default"
+
+#define SAMPLE_TRIG_PCM_CHANNELS 2
+#define SAMPLE_TRIG_QUEUE_SIZE   1024
+#define SAMPLE_TRIG_VOICE_MAX    64
+#define SAMPLE_TRIG_SCHEDULE_SIZE 1024
+#define SAMPLE_TRIG_REPLAY_END      UINT64_MAX
+#define SAMPLE_TRIG_REPLAY_POLL_NS  100000
+
+// Auto-tune backs off to twice the period once a window sees too many xruns or deadline misses
+#define SAMPLE_TRIG_TUNE_PERIOD_MAX 8192
+#define SAMPLE_TRIG_TUNE_MISS_MAX   2
+#define SAMPLE_TRIG_TUNE_WINDOW_NS  1000000000ull
+#define SAMPLE_TRIG_TUNE_SETTLE_NS  5000000000ull
 
 const char* sample_cmd_id_str[SAMPLE_ID_MAX_MSG] = {
     [SAMPLE_START]  =       "Sample start",
@@ -10,123 +22,599 @@ const char* sample_cmd_id_str[SAMPLE_ID_MAX_MSG] = {
     [SAMPLE_EXITED] =       "Sample exited",
 };
 
+static sample_engine_t sample_engine;
+
+
+static const char* sample_steal_str[SAMPLE_STEAL_MAX_POLICY] = {
+    [SAMPLE_STEAL_OLDEST]   =   "oldest",
+    [SAMPLE_STEAL_QUIETEST] =   "quietest",
+    [SAMPLE_STEAL_SAME]     =   "same",
+};
 
-static void sample_trig_notifier(audio_file_event_t event) {
+int sample_trig_parse_steal(const char* name, sample_steal_t* policy) {
 
-    switch (event) {
+    int i = 0;
 
-    case last_frame_event:
-        LOG_INFO("Last frame reached\n");
-        break;
+    for (i=0;i<SAMPLE_STEAL_MAX_POLICY;i++) {
 
-    default:
-        LOG_INFO("audio file event unknown\n");
-        break;
+        if (strcmp(name, sample_steal_str[i]) == 0) {
+            *policy = i;
+            return 0;
+        }
     }
+
+    LOG_ERROR("Unknown voice stealing policy '%s'\n", name);
+    return -1;
 }
 
-static void sample_trig_clean_thread(sample_trig_t *sample) {
+// Pick the voice to replace once the pool is full, bounded by the number of active voices
+static sample_voice_t* sample_engine_voice_steal(sample_engine_t* engine, sample_trig_t* sample, int same_only) {
+
+    int i = 0;
+    sample_voice_t* victim = NULL;
+    sample_voice_t* same = NULL;
+
+    for (i=0;i<engine->num_active;i++) {
+
+        sample_voice_t* voice = &engine->voice[i];
+
+        if (voice->sample == sample && (same == NULL || voice->seq < same->seq)) {
+            same = voice;
+        }
+
+        if (same_only) {
+            continue;
+        }
+
+        if (victim == NULL) {
+            victim = voice;
+        } else if (engine->steal == SAMPLE_STEAL_QUIETEST) {
 
-    LOG_INFO("Trig %d: clean thread\n", sample->id);
+            if (voice->gain < victim->gain || (voice->gain == victim->gain && voice->seq < victim->seq)) {
+                victim = voice;
+            }
+        } else if (voice->seq < victim->seq) {
+            victim = voice;
+        }
+    }
 
-    if (sample->file.handler != NULL) {
-        LOG_INFO("Trig %d: closing audio files\n", sample->id);
-        hal_sndfile_close(&sample->file);
+    if (same_only || (engine->steal == SAMPLE_STEAL_SAME && same != NULL)) {
+        return same;
     }
 
-    if (sample->alsa.pcm_handle != NULL) {
-        LOG_INFO("Trig %d: closing pcm handle\n", sample->id);
-        hal_alsa_pcm_close(sample->alsa.pcm_handle);
+    return victim;
+}
+
+// Give the stream of a finished or stolen voice back to the I/O thread
+static void sample_engine_voice_release(sample_engine_t* engine, sample_voice_t* voice) {
+
+    if (voice->stream != NULL) {
+        sample_stream_stop(&engine->streamer, voice->stream);
+        voice->stream = NULL;
     }
+}
 
-    LOG_INFO("Trig %d: de-init mqueue\n", sample->id);
-    if (hal_mqueue_deinit(&sample->mq) < 0) {
-        LOG_ERROR("Sample message deinit failure\n");
+// timestamp is the trigger call time, 0 when unknown, latency selects the voice for the latency histograms
+static void sample_engine_voice_start(sample_engine_t* engine, int id, int velocity, int offset, uint64_t timestamp, int latency) {
+
+    int i = 0;
+    int sample_voices = 0;
+    sample_voice_t* voice = NULL;
+
+    if (id < 0 || id >= engine->num_sample) {
+        LOG_RT_ERROR("Engine: sample id %d out of range\n", id);
+        return;
     }
 
-    if (sample != NULL) {
-        LOG_INFO("Trig %d: freeing sample\n", sample->id);
-        free(sample);
+    sample_trig_t* sample = engine->sample[id];
+
+    if (engine->polyphony > 0) {
+
+        for (i=0;i<engine->num_active;i++) {
+            sample_voices += (engine->voice[i].sample == sample);
+        }
+    }
+
+    if (engine->polyphony > 0 && sample_voices >= engine->polyphony) {
+
+        voice = sample_engine_voice_steal(engine, sample, 1);
+        sample_engine_voice_release(engine, voice);
+        LOG_RT_INFO("Trig %d: re-trigger oldest of %d voices\n", id, sample_voices);
+
+    } else if (engine->num_active < engine->max_voice) {
+
+        voice = &engine->voice[engine->num_active++];
+        LOG_RT_INFO("Trig %d: trigger sample, %d voices active\n", id, engine->num_active);
+
+    } else {
+
+        voice = sample_engine_voice_steal(engine, sample, 0);
+        sample_engine_voice_release(engine, voice);
+        engine->voice_stolen++;
+        LOG_RT_INFO("Trig %d: voice pool full, steal %s voice of sample %d\n", id, sample_steal_str[engine->steal], voice->sample->id);
+    }
+
+    voice->sample = sample;
+    voice->cursor = 0;
+    voice->gain = (velocity << SAMPLE_MIX_GAIN_SHIFT) / SAMPLE_VELOCITY_MAX;
+    voice->seq = engine->voice_seq++;
+    voice->offset = offset;
+    voice->trig_ts = latency ? timestamp : 0;
+    voice->stream = NULL;
+
+    if (engine->recording) {
+        uint64_t frame_clock = atomic_load_explicit(&engine->frame_clock, memory_order_relaxed);
+        sample_record_push(&engine->record, id, velocity, frame_clock + offset, timestamp);
+    }
+
+    // the I/O thread opens the file while the head plays
+    if (sample->buffer.stream_frames > 0) {
+        voice->stream = sample_stream_start(&engine->streamer, &sample->buffer);
     }
 }
 
-static void* sample_trig_thread(void* arg) {
+// Voices started this period reach the DAC once the frames already queued ahead of them are played
+static void sample_engine_latency_stamp(sample_engine_t* engine, int frames) {
 
-    if (arg == NULL) {
-        LOG_ERROR("Thread argument failure\n");
-        pthread_exit(NULL);
+    int i = 0;
+    uint64_t write_ts = sample_queue_timestamp();
+    long int delay = sample_output_delay(&engine->output);
+    uint64_t output_ts = 0;
+
+    // the delay includes the period just written, sinks without a queue report none
+    if (delay >= 0) {
+        long int backlog = (delay > frames) ? delay - frames : 0;
+        output_ts = write_ts + (uint64_t)backlog * 1000000000ull / engine->output.pcm_info.rate;
     }
 
-    int ret_msg = 0;
-    int frame_count = 0;
-    int thread_disable = 0;
-    int last_frame_flag = 0;
+    for (i=0;i<engine->num_active;i++) {
 
-    sample_trig_t* sample = (sample_trig_t*) arg;
+        sample_voice_t* voice = &engine->voice[i];
 
-    LOG_INFO("Starting sample Trig %d\n", sample->id);
+        if (voice->trig_ts == 0) {
+            continue;
+        }
 
-    sample->alsa.pcm_info.channel = sample->file.info.channels;
+        sample_latency_record(&engine->latency, SAMPLE_LATENCY_WRITE, write_ts - voice->trig_ts);
+        if (output_ts != 0) {
+            sample_latency_record(&engine->latency, SAMPLE_LATENCY_OUTPUT, output_ts - voice->trig_ts);
+        }
+        voice->trig_ts = 0;
+    }
+}
 
-    sample->alsa.pcm_handle = hal_alsa_pcm_open(SAMPLE_TRIG_PCM_NAME, &sample->alsa.pcm_info);
-    if (sample->alsa.pcm_handle == NULL) {
+static void sample_engine_mix_span(sample_engine_t* engine, int* bus, const short* src, int in_channels, long int frame_count, int gain) {
 
-        LOG_ERROR("Trig %d: Open pcm device failed\n", sample->id);
-        sample_trig_clean_thread(sample);
-        pthread_exit(NULL);
+    int i = 0;
+    int ch = 0;
+    int src_ch = 0;
+    int out_channels = engine->output.pcm_info.channel;
+
+    if (in_channels == out_channels) {
+
+        engine->mix->mix(bus, src, frame_count * out_channels, gain);
+
+    } else if (in_channels == 1 && out_channels == 2) {
+
+        engine->mix->mix_mono_stereo(bus, src, frame_count, gain);
+
+    } else {
+
+        for (i=0;i<frame_count;i++) {
+
+            for (ch=0;ch<out_channels;ch++) {
+
+                // mono is copied on each output channel, extra input channels are dropped
+                src_ch = (ch < in_channels) ? ch : in_channels-1;
+                bus[i*out_channels+ch] += (src[i*in_channels+src_ch] * gain) >> SAMPLE_MIX_GAIN_SHIFT;
+            }
+        }
     }
+}
 
+// Returns 1 once the voice reached the end of its sample
+static int sample_engine_mix_voice(sample_engine_t* engine, sample_voice_t* voice, int frames) {
 
-    while(thread_disable == 0) {
+    int out_channels = engine->output.pcm_info.channel;
+    sample_buffer_t* buffer = &voice->sample->buffer;
+    int* bus = engine->mix_bus;
+    const short* ring = NULL;
 
-        ret_msg = hal_mqueue_pull(&sample->mq, &sample->msg, 60);
-        if (ret_msg > 0) {
+    // scheduled start inside this render, the frames before it stay silent
+    if (voice->offset >= frames) {
+        voice->offset -= frames;
+        return 0;
+    }
+    bus += voice->offset * out_channels;
+    frames -= voice->offset;
+    voice->offset = 0;
+
+    // resident frames: the whole sample, or the head of a streamed one
+    long int frame_count = buffer->num_frames - voice->cursor;
+    if (frame_count > frames) {
+        frame_count = frames;
+    }
 
-            LOG_INFO("Trig %d: received audio message\n", sample->id);
-            switch (sample->msg.msg_id) {
+    if (frame_count > 0) {
 
-                case SAMPLE_START:
+        sample_engine_mix_span(engine, bus, buffer->pcm + voice->cursor * buffer->channels, buffer->channels, frame_count, voice->gain);
+        voice->cursor += frame_count;
+        engine->voice_frames += frame_count;
+        bus += frame_count * out_channels;
+        frames -= frame_count;
+    }
 
-                    sample->msg.msg_id = 99;
+    // voices without a stream slot stop at the end of the head
+    if (voice->stream == NULL) {
+        return voice->cursor >= buffer->num_frames;
+    }
 
-                    LOG_INFO("Trig %d: trigger sample\n", sample->id);
-                    LOG_INFO("Trig %d: pcm state: %d-%s\n", sample->id, hal_get_pcm_state_int(sample->alsa.pcm_handle), hal_get_pcm_state_str(sample->alsa.pcm_handle));
+    // the rest comes from the ring the I/O thread fills in output channels, a short ring leaves silence
+    while (frames > 0 && voice->cursor < buffer->stream_frames) {
 
-                    if (hal_get_pcm_state_int(sample->alsa.pcm_handle) != 2) {
-                        hal_alsa_pcm_drop_pending_samples(sample->alsa.pcm_handle);
-                        snd_pcm_prepare(sample->alsa.pcm_handle);
-                        LOG_INFO("Trig %d: pcm state: %d-%s\n", sample->id, hal_get_pcm_state_int(sample->alsa.pcm_handle), hal_get_pcm_state_str(sample->alsa.pcm_handle));
-                    }
+        frame_count = sample_stream_peek(&engine->streamer, voice->stream, &ring);
+        if (frame_count < 0) {
+            return 1;
+        }
+
+        if (frame_count == 0) {
+            atomic_fetch_add_explicit(&engine->streamer.underflows, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&engine->streamer.underflow_frames, frames, memory_order_relaxed);
+            break;
+        }
 
-                    while (!last_frame_flag) {
+        if (frame_count > frames) {
+            frame_count = frames;
+        }
 
-                        frame_count = hal_sndfile_read(&sample->file, sample->alsa.pcm_info.frames);
-                        if ((unsigned long)frame_count < sample->alsa.pcm_info.frames) {
+        sample_engine_mix_span(engine, bus, ring, out_channels, frame_count, voice->gain);
+        sample_stream_consume(&engine->streamer, voice->stream, frame_count);
+        voice->cursor += frame_count;
+        engine->voice_frames += frame_count;
+        bus += frame_count * out_channels;
+        frames -= frame_count;
+        engine->stream_kick = 1;
+    }
 
-                            last_frame_flag = 1;
-                        }
-                        hal_alsa_pcm_wait(sample->alsa.pcm_handle);
+    return voice->cursor >= buffer->stream_frames;
+}
 
-                        //LOG_DEBUG("Trig %d: %d/%d frame available\n", sample->id, hal_alsa_get_pcm_frame_avail(sample->alsa.pcm_handle), sample->alsa.pcm_info.buffer_size);
-                        hal_alsa_pcm_write(sample->alsa.pcm_handle, sample->file.buffer, frame_count);
+// Mix every active voice for frames frames and convert the result into out
+static int sample_engine_render(sample_engine_t* engine, short* out, int frames) {
 
-                        hal_mqueue_pull(&sample->mq, &sample->msg, 0);
-                        if (sample->msg.msg_id == SAMPLE_START) {
+    int i = 0;
+    int num_value = frames * engine->output.pcm_info.channel;
 
-                            sample->msg.msg_id = 99;
-                            LOG_INFO("Trig %d: re-trigger sample\n", sample->id);
-                            LOG_INFO("Trig %d: pcm state: %d-%s\n", sample->id, hal_get_pcm_state_int(sample->alsa.pcm_handle), hal_get_pcm_state_str(sample->alsa.pcm_handle));
+    memset(engine->mix_bus, 0, num_value * sizeof(int));
 
-                            hal_sndfile_reset_buff_ptr(&sample->file);
+    // active voices are kept packed at the front of the pool, a finished voice is replaced by the last one
+    i = 0;
+    while (i < engine->num_active) {
 
-                            if (hal_get_pcm_state_int(sample->alsa.pcm_handle) == 3) {
-                                hal_alsa_pcm_drop_pending_samples(sample->alsa.pcm_handle);
-                                snd_pcm_prepare(sample->alsa.pcm_handle);
-                            }
-                        }
-                    }
-                    last_frame_flag = 0;
-                    hal_sndfile_reset_buff_ptr(&sample->file);
+        if (sample_engine_mix_voice(engine, &engine->voice[i], frames)) {
+            sample_engine_voice_release(engine, &engine->voice[i]);
+            engine->voice[i] = engine->voice[--engine->num_active];
+        } else {
+            i++;
+        }
+    }
+
+    if (engine->stream_kick) {
+        sample_stream_kick(&engine->streamer);
+        engine->stream_kick = 0;
+    }
+
+    engine->mix->convert(out, engine->mix_bus, num_value);
+
+    return frames;
+}
+
+// Render one period straight into the device buffer, in several chunks when the area wraps.
+// Returns the frames committed, status is -EPIPE after an over/under run and -1 on any other
+// device error, the frames committed before it still count.
+static int sample_engine_render_direct(sample_engine_t* engine, int frames, int* status) {
+
+    int done = 0;
+    int ret = 0;
+    short* area = NULL;
+
+    *status = 0;
+
+    while (done < frames) {
+
+        ret = sample_output_begin(&engine->output, &area, frames - done);
+        if (ret < 0) {
+            *status = (ret == -EPIPE) ? -EPIPE : -1;
+            break;
+        }
+        if (ret == 0) {
+            break;
+        }
+
+        sample_engine_render(engine, area, ret);
+
+        int commit = sample_output_commit(&engine->output, ret);
+        if (commit == -EPIPE) {
+            *status = -EPIPE;
+            break;
+        }
+
+        // a stream that failed to start still holds the committed frames
+        done += ret;
+        if (commit < 0) {
+            *status = -1;
+            break;
+        }
+    }
+
+    return done;
+}
+
+// Frames spanned by a duration, seconds and remainder are scaled apart so that timestamps of
+// other processes days away cannot overflow, the result is the same as ns * rate / 1e9
+static uint64_t sample_engine_ns_to_frames(uint64_t ns, unsigned int rate) {
+
+    return ns / 1000000000ull * rate + ns % 1000000000ull * rate / 1000000000ull;
+}
+
+// Frame clock position at which a monotonic timestamp reaches the output
+static uint64_t sample_engine_monotonic_to_frame(sample_engine_t* engine, uint64_t when) {
+
+    uint64_t frame_clock = atomic_load_explicit(&engine->frame_clock, memory_order_relaxed);
+    unsigned int rate = engine->output.pcm_info.rate;
+
+    // the frames queued ahead of the next period delay it by the same amount, computed once per period
+    if (engine->period_ts == 0) {
+
+        long int delay = sample_output_delay(&engine->output);
+        engine->period_ts = sample_queue_timestamp();
+        if (delay > 0) {
+            engine->period_ts += (uint64_t)delay * 1000000000ull / rate;
+        }
+    }
+
+    if (when <= engine->period_ts) {
+
+        uint64_t late = sample_engine_ns_to_frames(engine->period_ts - when, rate);
+        return (late < frame_clock) ? frame_clock - late : 0;
+    }
+
+    return frame_clock + sample_engine_ns_to_frames(when - engine->period_ts, rate);
+}
+
+// Start a voice now, inside the next period, or keep the event for a later period
+static void sample_engine_event(sample_engine_t* engine, sample_event_t* event, int frames) {
+
+    uint64_t frame_clock = atomic_load_explicit(&engine->frame_clock, memory_order_relaxed);
+    uint64_t frame = 0;
+
+    if (event->flags == 0) {
+        sample_engine_voice_start(engine, event->id, event->velocity, 0, event->timestamp, engine->latency_enabled);
+        return;
+    }
+
+    frame = event->when;
+    if (event->flags & SAMPLE_EVENT_AT_MONOTONIC) {
+        frame = sample_engine_monotonic_to_frame(engine, event->when);
+    } else if (event->flags & SAMPLE_EVENT_AT_OFFSET) {
+        frame = frame_clock + event->when;
+    }
+
+    if (frame < frame_clock) {
+
+        engine->late_triggers++;
+        sample_engine_voice_start(engine, event->id, event->velocity, 0, event->timestamp, 0);
+
+    } else if (frame < frame_clock + frames) {
+
+        sample_engine_voice_start(engine, event->id, event->velocity, frame - frame_clock, event->timestamp, 0);
+
+    } else if (engine->num_schedule < SAMPLE_TRIG_SCHEDULE_SIZE) {
+
+        sample_event_t* pending = &engine->schedule[engine->num_schedule++];
+        *pending = *event;
+        pending->flags = SAMPLE_EVENT_AT_FRAME;
+        pending->when = frame;
+
+    } else {
+
+        LOG_RT_ERROR("Engine: schedule full, trigger %u starts now\n", event->id);
+        sample_engine_voice_start(engine, event->id, event->velocity, 0, event->timestamp, 0);
+    }
+}
+
+// Start the scheduled triggers falling into the next period
+static void sample_engine_schedule_run(sample_engine_t* engine, int frames) {
+
+    int i = 0;
+    uint64_t frame_clock = atomic_load_explicit(&engine->frame_clock, memory_order_relaxed);
+
+    while (i < engine->num_schedule) {
+
+        sample_event_t* pending = &engine->schedule[i];
+
+        if (pending->when < frame_clock + frames) {
+
+            uint64_t offset = (pending->when > frame_clock) ? pending->when - frame_clock : 0;
+            sample_engine_voice_start(engine, pending->id, pending->velocity, offset, pending->timestamp, 0);
+            *pending = engine->schedule[--engine->num_schedule];
+        } else {
+            i++;
+        }
+    }
+}
+
+static void sample_engine_autotune_reset(sample_engine_t* engine) {
+
+    engine->tune_miss = 0;
+    engine->tune_settled = 0;
+    engine->tune_window_ts = sample_queue_timestamp();
+    engine->tune_stable_ts = engine->tune_window_ts;
+}
+
+static int sample_engine_autotune(sample_engine_t* engine, int miss) {
+
+    uint64_t now = sample_queue_timestamp();
+    pcm_info_t* info = &engine->output.pcm_info;
+
+    engine->tune_miss += miss;
+    if (miss) {
+        engine->tune_stable_ts = now;
+    }
+
+    if (engine->tune_miss >= SAMPLE_TRIG_TUNE_MISS_MAX) {
+
+        unsigned long frames = info->frames * 2;
+
+        if (frames > engine->mix_frames) {
+
+            LOG_RT_WARN("Auto-tune: still unstable at %lu frames, giving up\n", info->frames);
+            engine->autotune = 0;
+            return 0;
+        }
+
+        LOG_RT_WARN("Auto-tune: %d xruns or deadline misses at %lu frames, backing off to %lu frames\n",
+                 engine->tune_miss, info->frames, frames);
+
+        if (sample_output_reopen(&engine->output, frames)) {
+            return -1;
+        }
+
+        if (info->frames > engine->mix_frames) {
+            LOG_RT_ERROR("Auto-tune: device period %lu frames above the %lu frames mix buffer\n", info->frames, engine->mix_frames);
+            return -1;
+        }
+
+        engine->direct = sample_output_direct(&engine->output);
+        sample_engine_autotune_reset(engine);
+        return 0;
+    }
+
+    if (now - engine->tune_window_ts >= SAMPLE_TRIG_TUNE_WINDOW_NS) {
+        engine->tune_miss = 0;
+        engine->tune_window_ts = now;
+    }
+
+    if (!engine->tune_settled && now - engine->tune_stable_ts >= SAMPLE_TRIG_TUNE_SETTLE_NS) {
+
+        engine->tune_settled = 1;
+        LOG_RT_INFO("Auto-tune: stable at %lu frames x %u periods, %u Hz, output latency %.2f ms\n",
+                 info->frames, info->periods, info->rate, info->buffer_size * 1000.0 / info->rate);
+    }
+
+    return 0;
+}
+
+// Replay renders offline, streamed voices wait for their ring instead of underflowing
+static int sample_engine_streams_ready(sample_engine_t* engine, int frames) {
+
+    int i = 0;
+
+    for (i=0;i<engine->num_active;i++) {
+
+        sample_voice_t* voice = &engine->voice[i];
+        sample_buffer_t* buffer = &voice->sample->buffer;
+
+        if (voice->stream == NULL) {
+            continue;
+        }
+
+        long int head = buffer->num_frames - voice->cursor;
+        long int need = frames - voice->offset - (head > 0 ? head : 0);
+        long int left = buffer->stream_frames - (head > 0 ? buffer->num_frames : voice->cursor);
+
+        if (need > left) {
+            need = left;
+        }
+
+        if (need > 0 && sample_stream_ready(&engine->streamer, voice->stream, need) == 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Publish the metrics of the period just rendered, relaxed stores and histogram increments only
+static void sample_engine_stats(sample_engine_t* engine, uint64_t render_ns, uint64_t wait_ns, uint64_t dequeued) {
+
+    sample_stats_block_t* block = engine->stats.block;
+    uint64_t period_frames = engine->output.pcm_info.frames;
+    uint64_t dropped = atomic_load_explicit(&engine->trig_dropped, memory_order_relaxed);
+
+    if (engine->shm_enabled) {
+        dropped += atomic_load_explicit(&engine->shm.ring->dropped, memory_order_relaxed);
+    }
+
+    sample_latency_hist_record(&block->render, render_ns);
+    sample_latency_hist_record(&block->wait, wait_ns);
+
+    atomic_store_explicit(&block->rate, engine->output.pcm_info.rate, memory_order_relaxed);
+    atomic_store_explicit(&block->period_frames, period_frames, memory_order_relaxed);
+    atomic_store_explicit(&block->budget_ns, period_frames * 1000000000ull / engine->output.pcm_info.rate, memory_order_relaxed);
+    atomic_store_explicit(&block->periods, atomic_load_explicit(&block->periods, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&block->frames, engine->output.frames_written, memory_order_relaxed);
+    atomic_store_explicit(&block->xruns, engine->xruns, memory_order_relaxed);
+    atomic_store_explicit(&block->deadline_miss, engine->deadline_miss, memory_order_relaxed);
+    atomic_store_explicit(&block->voices_active, engine->num_active, memory_order_relaxed);
+    atomic_store_explicit(&block->voices_stolen, engine->voice_stolen, memory_order_relaxed);
+    atomic_store_explicit(&block->triggers, atomic_load_explicit(&block->triggers, memory_order_relaxed) + dequeued, memory_order_relaxed);
+    atomic_store_explicit(&block->triggers_late, engine->late_triggers, memory_order_relaxed);
+    atomic_store_explicit(&block->triggers_dropped, dropped, memory_order_relaxed);
+    atomic_store_explicit(&block->triggers_rejected, engine->shm_rejected, memory_order_relaxed);
+    atomic_store_explicit(&block->wait_ns, atomic_load_explicit(&block->wait_ns, memory_order_relaxed) + wait_ns, memory_order_relaxed);
+
+    if ((uint64_t)engine->num_active > atomic_load_explicit(&block->voices_high, memory_order_relaxed)) {
+        atomic_store_explicit(&block->voices_high, engine->num_active, memory_order_relaxed);
+    }
+
+    if (dequeued > atomic_load_explicit(&block->queue_high, memory_order_relaxed)) {
+        atomic_store_explicit(&block->queue_high, dequeued, memory_order_relaxed);
+    }
+}
+
+static void* sample_engine_thread(void* arg) {
+
+    if (arg == NULL) {
+        LOG_RT_ERROR("Thread argument failure\n");
+        pthread_exit(NULL);
+    }
+
+    int frames = 0;
+    int ret = 0;
+    int miss = 0;
+    int thread_disable = 0;
+    uint64_t render_ts = 0;
+    uint64_t wait_ts = 0;
+    uint64_t dequeued = 0;
+    uint64_t replay_limit = 0;
+    struct timespec replay_poll = {0, SAMPLE_TRIG_REPLAY_POLL_NS};
+    sample_event_t event;
+
+    sample_engine_t* engine = (sample_engine_t*) arg;
+
+    // from now on the engine only logs through its own ring, formatting happens in the log thread
+    log_rt_register("engine");
+
+    LOG_RT_INFO("Starting sample engine\n");
+
+    if (engine->rt.enable) {
+        sample_rt_prefault_stack();
+    }
+
+    engine->start_ts = sample_queue_timestamp();
+    sample_engine_autotune_reset(engine);
+
+    while(thread_disable == 0) {
+
+        // Control messages and triggers are drained once per period, immediate triggers start on the next
+        // period boundary and scheduled ones at their frame inside the period they fall into
+        while (hal_mqueue_pull(&engine->mq, &engine->msg, 0) > 0) {
+
+            switch (engine->msg.msg_id) {
+
+                case SAMPLE_START:
+                    sample_engine_voice_start(engine, engine->msg.msg_val_int, SAMPLE_VELOCITY_MAX, 0, 0, 0);
                     break;
 
                 case SAMPLE_DEINIT:
@@ -134,30 +622,460 @@ static void* sample_trig_thread(void* arg) {
                     break;
             }
         }
+
+        frames = engine->output.pcm_info.frames;
+        engine->period_ts = 0;
+        dequeued = 0;
+
+        // offline replay: a period is only rendered once every trigger starting in it is queued
+        if (engine->replay) {
+            replay_limit = atomic_load_explicit(&engine->replay_limit, memory_order_acquire);
+        }
+
+        // a held replay period still drains the queue, its triggers start their voices without rendering
+        // so a period holding more triggers than the queue is filled in several rounds
+        while (sample_queue_pop(&engine->queue, &event) == 0) {
+
+            dequeued++;
+
+            if (engine->latency_enabled && event.flags == 0) {
+                sample_latency_record(&engine->latency, SAMPLE_LATENCY_DEQUEUE, sample_queue_timestamp() - event.timestamp);
+            }
+
+            sample_engine_event(engine, &event, frames);
+        }
+
+        if (engine->replay
+            && (atomic_load_explicit(&engine->replay_done, memory_order_relaxed)
+                || atomic_load_explicit(&engine->frame_clock, memory_order_relaxed) + frames > replay_limit)) {
+
+            nanosleep(&replay_poll, NULL);
+            continue;
+        }
+
+        // events from other processes are not trusted, ids and flags are checked before use
+        while (engine->shm_enabled && sample_shm_pop(&engine->shm, &event) == 0) {
+
+            dequeued++;
+
+            if (event.id >= (uint32_t)engine->num_sample
+                || (event.flags & ~(SAMPLE_EVENT_AT_FRAME | SAMPLE_EVENT_AT_MONOTONIC | SAMPLE_EVENT_AT_OFFSET))) {
+                engine->shm_rejected++;
+                continue;
+            }
+
+            if (event.velocity > SAMPLE_VELOCITY_MAX) {
+                event.velocity = SAMPLE_VELOCITY_MAX;
+            }
+
+            if (engine->latency_enabled && event.flags == 0) {
+                sample_latency_record(&engine->latency, SAMPLE_LATENCY_DEQUEUE, sample_queue_timestamp() - event.timestamp);
+            }
+
+            sample_engine_event(engine, &event, frames);
+        }
+
+        sample_engine_schedule_run(engine, frames);
+
+        if (engine->replay) {
+
+            // the replay is over once released and silent, its length does not depend on timing
+            if (replay_limit == SAMPLE_TRIG_REPLAY_END && engine->num_active == 0 && engine->num_schedule == 0) {
+                atomic_store_explicit(&engine->replay_done, 1, memory_order_release);
+                continue;
+            }
+
+            while (engine->streaming && sample_engine_streams_ready(engine, frames) == 0) {
+                sample_stream_kick(&engine->streamer);
+                nanosleep(&replay_poll, NULL);
+            }
+        }
+
+        miss = 0;
+
+        if (engine->direct) {
+
+            // the device area is only free once a period played, render after the wait
+            wait_ts = sample_queue_timestamp();
+            sample_output_wait(&engine->output);
+            wait_ts = sample_queue_timestamp() - wait_ts;
+
+            render_ts = sample_queue_timestamp();
+            frames = sample_engine_render_direct(engine, frames, &ret);
+            render_ts = sample_queue_timestamp() - render_ts;
+
+            if (ret == -EPIPE) {
+                engine->xruns++;
+                miss = 1;
+            } else if (ret < 0) {
+                LOG_RT_ERROR("Output device error, stopping engine\n");
+                thread_disable = 1;
+            }
+
+        } else {
+
+            render_ts = sample_queue_timestamp();
+            sample_engine_render(engine, engine->period_buffer, frames);
+            render_ts = sample_queue_timestamp() - render_ts;
+
+            wait_ts = sample_queue_timestamp();
+            sample_output_wait(&engine->output);
+            wait_ts = sample_queue_timestamp() - wait_ts;
+
+            if (sample_output_write(&engine->output, engine->period_buffer, frames) == -EPIPE) {
+                engine->xruns++;
+                miss = 1;
+            }
+        }
+
+        uint64_t frame_clock = atomic_fetch_add_explicit(&engine->frame_clock, frames, memory_order_relaxed) + frames;
+        if (engine->shm_enabled) {
+            atomic_store_explicit(&engine->shm.ring->frame_clock, frame_clock, memory_order_relaxed);
+        }
+
+        if (engine->realtime && frames > 0 && render_ts > frames * 1000000000ull / engine->output.pcm_info.rate) {
+            engine->deadline_miss++;
+            miss = 1;
+        }
+
+        if (engine->latency_enabled) {
+            sample_engine_latency_stamp(engine, frames);
+        }
+
+        if (engine->stats_enabled) {
+            sample_engine_stats(engine, render_ts, wait_ts, dequeued);
+        }
+
+        if (engine->autotune && thread_disable == 0 && sample_engine_autotune(engine, miss)) {
+            LOG_RT_ERROR("Auto-tune: reopen output failed, stopping engine\n");
+            thread_disable = 1;
+        }
     }
 
-    int sample_id = sample->id;
-    hal_mqueue_set_msg_id(&sample->msg, SAMPLE_EXITED);
-    hal_mqueue_push(&sample->mq, &sample->msg);
-    sample_trig_clean_thread(sample);
+    engine->stop_ts = sample_queue_timestamp();
 
-    LOG_INFO("Trig %d: exiting sample thread\n", sample_id);
+    // a replay still pushing triggers must not wait on a stopped engine
+    atomic_store_explicit(&engine->replay_done, 1, memory_order_release);
+
+    LOG_RT_INFO("Exiting sample engine\n");
     pthread_exit(NULL);
 }
 
+static void sample_engine_print_throughput(sample_engine_t* engine) {
+
+    double elapsed = (engine->stop_ts - engine->start_ts) / 1e9;
+
+    if (elapsed <= 0) {
+        return;
+    }
+
+    LOG_INFO("Engine throughput: %lu frames in %.3f s, %.0f frames/s (%.1fx realtime), %.0f voice frames/s\n",
+             (unsigned long)engine->output.frames_written, elapsed,
+             engine->output.frames_written / elapsed,
+             engine->output.frames_written / elapsed / engine->output.pcm_info.rate,
+             engine->voice_frames / elapsed);
+}
+
+static void sample_engine_clean(sample_engine_t* engine) {
+
+    LOG_INFO("Engine: closing output\n");
+    sample_output_close(&engine->output);
+
+    LOG_INFO("Engine: de-init mqueue\n");
+    if (hal_mqueue_deinit(&engine->mq) < 0) {
+        LOG_ERROR("Engine message deinit failure\n");
+    }
+
+    if (engine->shm_enabled) {
+        sample_shm_close(&engine->shm);
+        engine->shm_enabled = 0;
+    }
+
+    if (engine->stats_enabled) {
+        sample_stats_close(&engine->stats);
+        engine->stats_enabled = 0;
+    }
+
+    if (engine->recording) {
+        sample_record_close(&engine->record);
+        engine->recording = 0;
+    }
+
+    sample_stream_deinit(&engine->streamer);
+    sample_queue_deinit(&engine->queue);
+    free(engine->schedule);
+    engine->schedule = NULL;
+
+    free(engine->mix_bus);
+    free(engine->period_buffer);
+    free(engine->voice);
+    engine->mix_bus = NULL;
+    engine->period_buffer = NULL;
+    engine->voice = NULL;
+}
+
+// Bring a bank entry to the output rate and channel count, down mixing first and up mixing last
+// so the rate conversion runs on as few channels as possible. Mono entries stay mono, the mixing
+// kernel spreads them over the output channels, so a mapped mono file keeps playing from the page cache.
+static int sample_engine_conform(sample_engine_t* engine, sample_buffer_t* buffer) {
+
+    int channels = engine->output.pcm_info.channel;
+    int rate = engine->output.pcm_info.rate;
+
+    // streamed frames are only mixed to the output channels on the fly, another rate needs the whole sample
+    if (buffer->stream_frames > 0 && buffer->rate != rate) {
+
+        char* path = strdup(buffer->path);
+
+        LOG_WARN("Sample %s: %d Hz differs from the output, loading it whole instead of streaming\n", path, buffer->rate);
+        sample_bank_unload(buffer);
+        if (path == NULL || sample_bank_load(buffer, path, 0)) {
+            free(path);
+            return -1;
+        }
+        free(path);
+    }
+
+    if (buffer->channels > channels && sample_bank_set_channels(buffer, channels)) {
+        return -1;
+    }
+
+    if (sample_bank_resample(buffer, rate)) {
+        return -1;
+    }
+
+    if (buffer->channels != 1 && sample_bank_set_channels(buffer, channels)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Negotiate the output format before any sample is loaded, the sample cache is keyed on it
+static int sample_engine_open_output(sample_engine_t* engine, sample_trig_config_t* config) {
+
+    memset(engine, 0, sizeof(sample_engine_t));
+
+    engine->output.pcm_info.channel = SAMPLE_TRIG_PCM_CHANNELS;
+    engine->output.pcm_info.rate = config->rate;
+    engine->output.pcm_info.frames = config->autotune ? 1 : config->period_frames;
+    engine->output.pcm_info.periods = config->periods;
+    engine->output.pcm_info.mmap = config->mmap;
+    if (sample_output_open(&engine->output, config->output, config->output_target)) {
+
+        LOG_ERROR("Engine: Open output failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// The output is already open, see sample_engine_open_output
+static int sample_engine_init(sample_engine_t* engine, sample_trig_t** sample, int num_sample, sample_trig_config_t* config) {
+
+    int i = 0;
+    int ret = 0;
+
+    engine->sample = sample;
+    engine->num_sample = num_sample;
+    engine->max_voice = (config->max_voices > 0) ? config->max_voices : SAMPLE_TRIG_VOICE_MAX;
+    engine->polyphony = config->polyphony;
+    engine->steal = config->steal;
+
+    engine->mix = sample_mix_select(config->mix_kernel);
+    if (engine->mix == NULL) {
+        LOG_ERROR("Engine: no mix kernel\n");
+        sample_output_close(&engine->output);
+        return -1;
+    }
+    LOG_INFO("Engine: %s mix kernel\n", engine->mix->name);
+
+    engine->voice = calloc(engine->max_voice, sizeof(sample_voice_t));
+    if (engine->voice == NULL) {
+        LOG_ERROR("Engine: allocate %d voices: %s\n", engine->max_voice, strerror(errno));
+        sample_output_close(&engine->output);
+        return -1;
+    }
+    engine->latency_enabled = config->latency;
+    sample_latency_reset(&engine->latency);
+
+    if (hal_mqueue_init(&engine->mq, SAMPLE_TRIG_MQEUE_NAME, NULL) < 0) {
+        LOG_ERROR("Engine message init failure\n");
+        free(engine->voice);
+        engine->voice = NULL;
+        sample_output_close(&engine->output);
+        return -1;
+    }
+
+    engine->msg.msg_id_str = sample_cmd_id_str;
+    engine->msg.msg_id_max = SAMPLE_ID_MAX_MSG;
+
+    if (sample_queue_init(&engine->queue, SAMPLE_TRIG_QUEUE_SIZE) < 0) {
+        LOG_ERROR("Engine trigger queue init failure\n");
+        sample_engine_clean(engine);
+        return -1;
+    }
+
+    engine->schedule = malloc(SAMPLE_TRIG_SCHEDULE_SIZE * sizeof(sample_event_t));
+    if (engine->schedule == NULL) {
+        LOG_ERROR("Engine: allocate schedule: %s\n", strerror(errno));
+        sample_engine_clean(engine);
+        return -1;
+    }
+    atomic_init(&engine->frame_clock, 0);
+    atomic_init(&engine->trig_dropped, 0);
+
+    // cache misses and streamed heads are converted to the negotiated format before playback
+    for (i=0;i<num_sample;i++) {
+
+        if (sample_engine_conform(engine, &sample[i]->buffer)) {
+            LOG_ERROR("Engine: sample %d format conversion failed\n", i);
+            sample_engine_clean(engine);
+            return -1;
+        }
+
+        // mapped samples are cache hits or canonical files already, only decoded ones are worth storing
+        if (config->cache_dir != NULL && sample[i]->buffer.map_addr == NULL && sample[i]->buffer.stream_frames == 0) {
+            sample_cache_store(&sample[i]->buffer, config->cache_dir, sample[i]->buffer.path);
+        }
+    }
+
+    for (i=0;i<num_sample;i++) {
+        engine->streaming |= (sample[i]->buffer.stream_frames > 0);
+    }
+
+    if (engine->streaming) {
+
+        int ahead_ms = config->stream_ahead_ms ? config->stream_ahead_ms : SAMPLE_STREAM_AHEAD_MS;
+        unsigned long ring_frames = (unsigned long)engine->output.pcm_info.rate * ahead_ms / 1000;
+
+        if (sample_stream_init(&engine->streamer, SAMPLE_STREAM_SLOTS, engine->output.pcm_info.channel, ring_frames)) {
+            LOG_ERROR("Engine: sample streaming init failed\n");
+            sample_engine_clean(engine);
+            return -1;
+        }
+    }
+
+    if (config->shm_name != NULL) {
+
+        if (sample_shm_create(&engine->shm, config->shm_name, num_sample, engine->output.pcm_info.rate)) {
+            LOG_ERROR("Engine: shared trigger ring init failed\n");
+            sample_engine_clean(engine);
+            return -1;
+        }
+        engine->shm_enabled = 1;
+    }
+
+    if (config->record_path != NULL) {
+
+        if (sample_record_open(&engine->record, config->record_path, engine->output.pcm_info.rate,
+                               engine->output.pcm_info.frames, num_sample)) {
+            sample_engine_clean(engine);
+            return -1;
+        }
+        engine->recording = 1;
+    }
+
+    // replays start held at frame 0 and hash their output to compare runs
+    engine->replay = config->replay;
+    atomic_init(&engine->replay_limit, 0);
+    atomic_init(&engine->replay_done, 0);
+    if (engine->replay) {
+        sample_output_hash_enable(&engine->output);
+    }
+
+    if (config->stats_name != NULL) {
+
+        char output_name[SAMPLE_STATS_NAME_MAX];
+
+        snprintf(output_name, sizeof(output_name), "%s%s%s", engine->output.ops->name,
+                 engine->output.target ? ":" : "", engine->output.target ? engine->output.target : "");
+
+        if (sample_stats_create(&engine->stats, config->stats_name, output_name)) {
+            LOG_ERROR("Engine: stats block init failed\n");
+            sample_engine_clean(engine);
+            return -1;
+        }
+        engine->stats_enabled = 1;
+    }
+
+    engine->realtime = sample_output_realtime(&engine->output);
+    engine->direct = sample_output_direct(&engine->output);
+    engine->autotune = config->autotune && engine->realtime;
+
+    // auto-tune may grow the period, buffers are sized once for the largest one
+    engine->mix_frames = engine->output.pcm_info.frames;
+    if (engine->autotune && engine->mix_frames < SAMPLE_TRIG_TUNE_PERIOD_MAX) {
+        engine->mix_frames = SAMPLE_TRIG_TUNE_PERIOD_MAX;
+    }
+
+    int num_value = engine->mix_frames * engine->output.pcm_info.channel;
+
+    engine->mix_bus = malloc(num_value * sizeof(int));
+    engine->period_buffer = malloc(num_value * sizeof(short));
+    if (engine->mix_bus == NULL || engine->period_buffer == NULL) {
+
+        LOG_ERROR("Engine: allocate mix buffers: %s\n", strerror(errno));
+        sample_engine_clean(engine);
+        return -1;
+    }
+
+    if (engine->rt.enable) {
+        ret = sample_rt_thread_create(&engine->rt, &engine->tid, sample_engine_thread, (void*)engine);
+    } else {
+        ret = pthread_create(&engine->tid, NULL, sample_engine_thread, (void*)engine);
+    }
+    if (ret) {
+        LOG_ERROR("Thread create: %s\n", strerror(ret));
+        sample_engine_clean(engine);
+        return -1;
+    }
+
+    // checked from here, the report must not block the audio thread
+    if (engine->rt.enable) {
+        sample_rt_self_check(&engine->rt, engine->tid);
+    }
+
+    return 0;
+}
+
 static void sample_trig_free_resources(sample_trig_t** sample_ptr, int num_resource) {
 
     int i = 0;
     for(i=0;i<=num_resource;i++) {
 
+        if (i < num_resource) {
+            sample_bank_unload(&sample_ptr[i]->buffer);
+        }
         free(sample_ptr[i]);
+        sample_ptr[i] = NULL;
     }
 }
 
-int sample_trig_init(sample_trig_t**sample, char** list_sample, int num_sample) {
+int sample_trig_init(sample_trig_t**sample, char** list_sample, int num_sample, sample_trig_config_t* config) {
 
     int i = 0;
     int ret = 0;
+    int cache_hits = 0;
+    int num_stream = 0;
+    size_t mem_total = 0;
+    size_t map_total = 0;
+    uint64_t load_ts = 0;
+    sample_trig_config_t config_default = {0};
+
+    if (config == NULL) {
+        config = &config_default;
+    }
+
+    // cache entries are looked up in the format the output negotiated, which may differ from the request,
+    // or in mono at that rate since mono samples are kept mono
+    if (sample_engine_open_output(&sample_engine, config)) {
+        return -1;
+    }
+
+    int cache_rate = sample_engine.output.pcm_info.rate;
+    int cache_channels = sample_engine.output.pcm_info.channel;
+    load_ts = sample_queue_timestamp();
 
     for (i=0;i< num_sample;i++) {
 
@@ -165,85 +1083,310 @@ int sample_trig_init(sample_trig_t**sample, char** list_sample, int num_sample)
         if (sample[i] == NULL) {
 
             LOG_ERROR("Sample %d allocation: %s\n", i, strerror(errno));
+            sample_trig_free_resources(sample, i);
+            sample_output_close(&sample_engine.output);
             return -1;
         }
 
-        if (hal_sndfile_open(&sample[i]->file, list_sample[i+1])) {
+        ret = 1;
+        if (config->stream_threshold > 0) {
+            ret = sample_bank_load_head(&sample[i]->buffer, list_sample[i], config->stream_threshold,
+                                        config->stream_head_ms ? config->stream_head_ms : SAMPLE_STREAM_HEAD_MS);
+        }
+
+        if (ret == 0) {
 
-            LOG_ERROR("Sample open failed\n");
+            num_stream++;
+
+        } else if (ret < 0) {
+
+            LOG_ERROR("Sample load failed\n");
             sample_trig_free_resources(sample, i);
+            sample_output_close(&sample_engine.output);
             return -1;
-        }
 
-        if (hal_sndfile_check_wav_s16_format(&sample[i]->file)) {
-            LOG_ERROR("Sample format not supported for %s", list_sample[i+1]);
-            return -1;
-        }
+        } else if (config->cache_dir != NULL
+            && (sample_cache_load(&sample[i]->buffer, config->cache_dir, list_sample[i],
+                                  cache_rate, cache_channels, config->bank_flags) == 0
+                || sample_cache_load(&sample[i]->buffer, config->cache_dir, list_sample[i],
+                                     cache_rate, 1, config->bank_flags) == 0)) {
+
+            cache_hits++;
+        } else if (sample_bank_load(&sample[i]->buffer, list_sample[i], config->bank_flags)) {
 
-        char sample_mq_name[CH_NAME_MAX] = {0};
-        sprintf(sample_mq_name, "%s_%d", SAMPLE_TRIG_MQEUE_NAME, i);
-        if (hal_mqueue_init(&sample[i]->mq, sample_mq_name, NULL) < 0) {
-            LOG_ERROR("Sample message init failure\n");
+            LOG_ERROR("Sample load failed\n");
+            sample_trig_free_resources(sample, i);
+            sample_output_close(&sample_engine.output);
             return -1;
         }
 
         sample[i]->id = i;
-        sample[i]->msg.msg_id_str = sample_cmd_id_str;
-        sample[i]->msg.msg_id_max = SAMPLE_ID_MAX_MSG;
+        mem_total += sample[i]->buffer.mem_size;
+        map_total += sample[i]->buffer.map_size;
+    }
 
-        ret = pthread_create(&sample[i]->tid, NULL, sample_trig_thread, (void*)sample[i]);
-        if (ret) {
-            LOG_ERROR("Thread create: %s\n", strerror(errno));
-            sample_trig_free_resources(sample, i);
-            return -1;
-        }
-        ret = pthread_detach(sample[i]->tid); //thread will never be joined
-        if (ret) {
-            LOG_ERROR("Thread detach: %s\n", strerror(errno));
-            sample_trig_free_resources(sample, i);
-            return -1;
+    LOG_INFO("Sample bank: %d samples (%d from cache, %d streamed) in %.2f ms, %zu bytes resident, %zu bytes mapped\n",
+             num_sample, cache_hits, num_stream, (sample_queue_timestamp() - load_ts) / 1e6, mem_total, map_total);
+
+    sample_engine.rt.enable = config->rt;
+    sample_engine.rt.priority = config->rt_priority;
+    sample_engine.rt.cpus = config->rt_cpus;
+
+    if (config->rt) {
+
+        // lock before the engine allocates so its buffers are covered by MCL_FUTURE
+        sample_rt_lock_memory(&sample_engine.rt);
+
+        for (i=0;i<num_sample;i++) {
+            sample_bank_prefault(&sample[i]->buffer);
         }
     }
 
-    hal_sndfile_set_notification_callback(sample_trig_notifier);
+    if (sample_engine_init(&sample_engine, sample, num_sample, config)) {
+
+        LOG_ERROR("Sample engine init failed\n");
+        return -1;
+    }
 
     return 0;
 }
 
-int sample_trig(sample_trig_t** sample_list, sample_id_t id) {
+static int sample_trig_push(sample_trig_t** sample_list, sample_id_t id, uint8_t velocity, uint8_t flags, uint64_t when) {
+
+    sample_event_t event;
 
-    if (sample_list[id] == NULL)
+    if (id >= (sample_id_t)sample_engine.num_sample || sample_list[id] == NULL)
         return -1;
 
-    hal_mqueue_set_msg_id(&sample_list[id]->msg, SAMPLE_START);
+    event.id = id;
+    event.velocity = (velocity > SAMPLE_VELOCITY_MAX) ? SAMPLE_VELOCITY_MAX : velocity;
+    event.flags = flags;
+    event.timestamp = sample_queue_timestamp();
+    event.when = when;
 
-    if (hal_mqueue_push(&sample_list[id]->mq, &sample_list[id]->msg) < 0) {
-        LOG_ERROR("Sample message push failed\n");
+    if (sample_queue_push(&sample_engine.queue, &event) < 0) {
+        atomic_fetch_add_explicit(&sample_engine.trig_dropped, 1, memory_order_relaxed);
+        LOG_ERROR("Sample trigger queue full, trigger %d dropped\n", id);
         return -1;
     }
 
     return 0;
 }
 
-int sample_trig_exit(sample_trig_t** sample_list, int num_sample) {
+int sample_trig(sample_trig_t** sample_list, sample_id_t id) {
+
+    return sample_trig_push(sample_list, id, SAMPLE_VELOCITY_MAX, 0, 0);
+}
+
+// Velocity 1 to 127 scales the voice gain linearly, 127 plays the sample at unity gain
+int sample_trig_velocity(sample_trig_t** sample_list, sample_id_t id, uint8_t velocity) {
+
+    return sample_trig_push(sample_list, id, velocity, 0, 0);
+}
+
+// Queue events as one unit: they are dequeued together and start in the same period, each at its
+// frame offset from that period start. Nothing is queued when an id is invalid or the queue lacks room.
+int sample_trig_batch(sample_trig_t** sample_list, const sample_trig_event_t* events, int count) {
 
     int i = 0;
+    sample_event_t batch[SAMPLE_TRIG_BATCH_MAX];
+    uint64_t timestamp = sample_queue_timestamp();
 
-    for (i=0;i<num_sample;i++) {
+    if (count <= 0 || count > SAMPLE_TRIG_BATCH_MAX) {
+        LOG_ERROR("Sample trigger batch of %d events, 1 to %d allowed\n", count, SAMPLE_TRIG_BATCH_MAX);
+        return -1;
+    }
 
-        hal_mqueue_set_msg_id(&sample_list[i]->msg, SAMPLE_DEINIT);
-        if (hal_mqueue_push(&sample_list[i]->mq, &sample_list[i]->msg) < 0) {
-            LOG_ERROR("Sample message push failed\n");
+    for (i=0;i<count;i++) {
+
+        if (events[i].id >= (sample_id_t)sample_engine.num_sample || sample_list[events[i].id] == NULL) {
+            LOG_ERROR("Sample trigger batch: unknown sample %u\n", events[i].id);
             return -1;
         }
+
+        batch[i].id = events[i].id;
+        batch[i].velocity = (events[i].velocity > SAMPLE_VELOCITY_MAX) ? SAMPLE_VELOCITY_MAX : events[i].velocity;
+        batch[i].flags = SAMPLE_EVENT_AT_OFFSET;
+        batch[i].timestamp = timestamp;
+        batch[i].when = events[i].offset;
     }
 
-    for (i=0;i<num_sample;i++) {
+    if (sample_queue_push_batch(&sample_engine.queue, batch, count) < 0) {
+        atomic_fetch_add_explicit(&sample_engine.trig_dropped, count, memory_order_relaxed);
+        LOG_ERROR("Sample trigger queue full, batch of %d dropped\n", count);
+        return -1;
+    }
 
-        if (hal_mqueue_pull(&sample_list[i]->mq, &sample_list[i]->msg, 1) < 0) {
-            LOG_ERROR("Sample message pull failed\n");
-            return -1;
+    return 0;
+}
+
+// Feed a recorded session through the trigger path. The engine is held at the start of the period
+// holding the next recorded start until every trigger of that period is queued, so each one is
+// dequeued and started within its own period in recorded order and the render does not depend on
+// how fast this thread runs. A held engine keeps draining the queue, so a period may hold more starts
+// than the queue. Returns once every voice finished, -1 when the engine stopped first.
+int sample_trig_replay(sample_trig_t** sample_list, sample_replay_t* replay) {
+
+    sample_engine_t* engine = &sample_engine;
+    uint64_t period = engine->output.pcm_info.frames;
+    uint64_t count = 0;
+    uint64_t skipped = 0;
+    uint64_t group = 0;
+    uint64_t start_ts = sample_queue_timestamp();
+    uint64_t frames = 0;
+    double elapsed = 0;
+    struct timespec poll = {0, SAMPLE_TRIG_REPLAY_POLL_NS};
+    sample_record_event_t event;
+    sample_event_t trig;
+
+    if (engine->replay == 0) {
+        LOG_ERROR("Sample engine not started for replay\n");
+        return -1;
+    }
+
+    if (replay->header.rate != engine->output.pcm_info.rate || replay->header.period_frames != period) {
+        LOG_WARN("Replay: recorded at %u Hz with %u frame periods, rendering at %u Hz with %lu frame periods\n",
+                 replay->header.rate, replay->header.period_frames, engine->output.pcm_info.rate, (unsigned long)period);
+    }
+
+    int more = (sample_replay_next(replay, &event) == 0);
+
+    if (more) {
+        atomic_store_explicit(&engine->replay_limit, event.frame - event.frame % period, memory_order_release);
+    }
+
+    while (more) {
+
+        group = event.frame - event.frame % period;
+
+        // the engine renders up to the group start and waits there
+        while (atomic_load_explicit(&engine->frame_clock, memory_order_relaxed) < group) {
+
+            if (atomic_load_explicit(&engine->replay_done, memory_order_acquire)) {
+                LOG_ERROR("Replay: engine stopped at frame %lu before frame %lu\n",
+                          (unsigned long)atomic_load(&engine->frame_clock), (unsigned long)group);
+                return -1;
+            }
+            nanosleep(&poll, NULL);
         }
+
+        do {
+            if (event.id >= (uint32_t)engine->num_sample || sample_list[event.id] == NULL) {
+
+                skipped++;
+
+            } else {
+
+                trig.id = event.id;
+                trig.velocity = (event.velocity > SAMPLE_VELOCITY_MAX) ? SAMPLE_VELOCITY_MAX : event.velocity;
+                trig.flags = SAMPLE_EVENT_AT_FRAME;
+                trig.timestamp = sample_queue_timestamp();
+                trig.when = event.frame;
+
+                // the engine held at the group start keeps draining the queue, a full queue only waits for it
+                while (sample_queue_push(&engine->queue, &trig) < 0) {
+
+                    if (atomic_load_explicit(&engine->replay_done, memory_order_acquire)) {
+                        LOG_ERROR("Replay: engine stopped, trigger %u at frame %lu not replayed\n",
+                                  event.id, (unsigned long)event.frame);
+                        return -1;
+                    }
+                    nanosleep(&poll, NULL);
+                }
+                count++;
+            }
+            more = (sample_replay_next(replay, &event) == 0);
+
+        } while (more && event.frame < group + period);
+
+        atomic_store_explicit(&engine->replay_limit, more ? event.frame - event.frame % period : SAMPLE_TRIG_REPLAY_END,
+                              memory_order_release);
+    }
+
+    atomic_store_explicit(&engine->replay_limit, SAMPLE_TRIG_REPLAY_END, memory_order_release);
+
+    while (atomic_load_explicit(&engine->replay_done, memory_order_acquire) == 0) {
+        nanosleep(&poll, NULL);
+    }
+
+    frames = atomic_load(&engine->frame_clock);
+    elapsed = (sample_queue_timestamp() - start_ts) / 1e9;
+
+    if (skipped > 0) {
+        LOG_WARN("Replay: %lu triggers of unknown samples skipped\n", (unsigned long)skipped);
+    }
+
+    LOG_INFO("Replay: %lu triggers, %lu frames rendered in %.3f s (%.1fx realtime)\n", (unsigned long)count,
+             (unsigned long)frames, elapsed, elapsed > 0 ? frames / elapsed / engine->output.pcm_info.rate : 0.0);
+
+    return 0;
+}
+
+// Start a sample at an exact frame, timestamps already in the past start as soon as possible
+int sample_trig_at(sample_trig_t** sample_list, sample_id_t id, sample_clock_t clock, uint64_t timestamp) {
+
+    if (clock >= SAMPLE_CLOCK_MAX) {
+        LOG_ERROR("Sample trigger clock %d unknown\n", clock);
+        return -1;
+    }
+
+    return sample_trig_push(sample_list, id, SAMPLE_VELOCITY_MAX, (clock == SAMPLE_CLOCK_FRAME) ? SAMPLE_EVENT_AT_FRAME : SAMPLE_EVENT_AT_MONOTONIC, timestamp);
+}
+
+// Frame clock position of the next period the engine renders, for scheduling ahead with SAMPLE_CLOCK_FRAME
+uint64_t sample_trig_frame_clock(void) {
+
+    return atomic_load_explicit(&sample_engine.frame_clock, memory_order_relaxed);
+}
+
+int sample_trig_exit(sample_trig_t** sample_list, int num_sample) {
+
+    int i = 0;
+    msg_t msg = sample_engine.msg;
+
+    hal_mqueue_set_msg_id(&msg, SAMPLE_DEINIT);
+    if (hal_mqueue_push(&sample_engine.mq, &msg) < 0) {
+        LOG_ERROR("Sample message push failed\n");
+        return -1;
+    }
+
+    if (pthread_join(sample_engine.tid, NULL)) {
+        LOG_ERROR("Engine thread join failed\n");
+        return -1;
+    }
+
+    if (sample_engine.latency_enabled) {
+        sample_latency_print(&sample_engine.latency);
+    }
+
+    sample_engine_print_throughput(&sample_engine);
+    LOG_INFO("Engine voices: %d max, %lu stolen\n", sample_engine.max_voice, (unsigned long)sample_engine.voice_stolen);
+    LOG_INFO("Engine periods: %lu frames, %lu xruns, %lu deadline misses, %lu late scheduled triggers, %lu triggers dropped\n", sample_engine.output.pcm_info.frames,
+             (unsigned long)sample_engine.xruns, (unsigned long)sample_engine.deadline_miss, (unsigned long)sample_engine.late_triggers,
+             (unsigned long)atomic_load(&sample_engine.trig_dropped));
+
+    if (sample_engine.streaming) {
+        sample_stream_print(&sample_engine.streamer);
+    }
+
+    if (sample_engine.output.hash_enabled) {
+        LOG_INFO("Output hash: %016lx over %lu frames\n", (unsigned long)sample_engine.output.hash,
+                 (unsigned long)sample_engine.output.frames_written);
+    }
+
+    if (sample_engine.shm_enabled) {
+        LOG_INFO("Shared trigger ring: %lu dropped (ring full), %lu rejected\n",
+                 (unsigned long)atomic_load(&sample_engine.shm.ring->dropped), (unsigned long)sample_engine.shm_rejected);
+    }
+
+    sample_engine_clean(&sample_engine);
+
+    for (i=0;i<num_sample;i++) {
+
+        LOG_DEBUG("Trig %d: unloading sample\n", sample_list[i]->id);
+        sample_bank_unload(&sample_list[i]->buffer);
+        free(sample_list[i]);
+        sample_list[i] = NULL;
     }
 
     return 0;
@@ -1,8 +1,22 @@
+#ifndef SAMPLE_TRIG_H
+#define SAMPLE_TRIG_H
+
 #include <pthread.h>
 #include <fcntl.h>
-#include "hal_alsa.h"
+#include "sample_output.h"
 #include "hal_mqueue.h"
-#include "hal_sndfile.h"
+#include "sample_bank.h"
+#include "sample_cache.h"
+#include "sample_queue.h"
+#include "sample_latency.h"
+#include "sample_mix.h"
+#include "sample_rt.h"
+#include "sample_stream.h"
+#include "sample_shm.h"
+#include "sample_stats.h"
+#include "sample_record.h"
+
+#define SAMPLE_TRIG_BATCH_MAX   64      // events per sample_trig_batch() call
 
 typedef enum sample_cmd_id {
     SAMPLE_START=0,
@@ -13,28 +27,148 @@ typedef enum sample_cmd_id {
 
 } sample_cmd_id_t;
 
-typedef enum samples_trig_id {
-    sample_0,
-    sample_1,
-    sample_2,
-    sample_3,
-    sample_4,
-    sample_5,
+// Index of a sample in the list given to sample_trig_init, see sample_kit for names
+typedef uint32_t sample_id_t;
+
+// Clock of a scheduled trigger timestamp
+typedef enum sample_clock {
+    SAMPLE_CLOCK_FRAME=0,       // engine frame clock, frames rendered since the engine started
+    SAMPLE_CLOCK_MONOTONIC,     // CLOCK_MONOTONIC in ns, the time the first frame should be heard
+
+    SAMPLE_CLOCK_MAX,
+
+} sample_clock_t;
+
+// Victim selection when the voice pool is full
+typedef enum sample_steal {
+    SAMPLE_STEAL_OLDEST=0,
+    SAMPLE_STEAL_QUIETEST,
+    SAMPLE_STEAL_SAME,      // oldest voice of the triggered sample, else oldest voice
+
+    SAMPLE_STEAL_MAX_POLICY,
+
+} sample_steal_t;
+
+// Engine configuration, NULL selects the defaults
+typedef struct sample_trig_config {
+    int             bank_flags;
+    int             latency;        // record trigger to output latency histograms
+    sample_output_type_t output;
+    char*           output_target;  // pcm device or file name, NULL selects the backend default
+    int             max_voices;     // global voice cap, 0 selects the default
+    int             polyphony;      // voices per sample, 0 is only bounded by the global cap
+    sample_steal_t  steal;
+    char*           mix_kernel;     // scalar, sse2 or avx2, NULL selects the best supported
+    unsigned int    rate;           // output rate, 0 selects the default
+    unsigned long   period_frames;  // period size, 0 selects the default
+    unsigned int    periods;        // periods per buffer, 0 selects the default
+    int             autotune;       // start at the smallest period and back off on xruns
+    int             mmap;           // render straight into the pcm device buffer when it allows mmap access
+    int             rt;             // SCHED_FIFO audio thread, locked and prefaulted memory
+    int             rt_priority;    // 0 selects the default
+    char*           rt_cpus;        // audio thread cpu list, NULL keeps the inherited affinity
+    char*           cache_dir;      // converted sample cache directory, NULL disables the cache
+    size_t          stream_threshold;   // stream samples decoding to more bytes than this, 0 loads them all
+    int             stream_head_ms; // resident head of streamed samples, 0 selects the default
+    int             stream_ahead_ms;    // read-ahead of streamed voices, 0 selects the default
+    char*           shm_name;       // shared memory trigger ring for other processes, NULL disables it
+    char*           stats_name;     // shared memory runtime stats block, NULL disables it
+    char*           record_path;    // log every voice start to this file, NULL disables recording
+    int             replay;         // offline replay: the engine only renders periods released by sample_trig_replay
+
+} sample_trig_config_t;
 
-    samples_max,
+// One event of a sample_trig_batch() call
+typedef struct sample_trig_event {
+    sample_id_t     id;
+    uint8_t         velocity;       // 1 to 127, 127 plays at unity gain
+    uint32_t        offset;         // frames after the start of the period the batch lands in
 
-} sample_id_t;
+} sample_trig_event_t;
 
 typedef struct sample_trig {
-    pthread_t       tid;
     sample_id_t     id;
+    sample_buffer_t buffer;
+
+} sample_trig_t;
+
+// Voice playing one sample into the mix bus
+typedef struct sample_voice {
+    sample_trig_t*  sample;
+    long int        cursor;
+    int             gain;
+    uint64_t        seq;            // start order, lower is older
+    int             offset;         // silent frames before the first frame, for starts inside a period
+    uint64_t        trig_ts;        // trigger timestamp, 0 once the latency is recorded
+    sample_stream_t* stream;        // ring of a streamed sample past its head, NULL otherwise
+
+} sample_voice_t;
+
+// Mixer engine: one thread owning one pcm device and summing all active voices
+typedef struct sample_engine {
+    pthread_t       tid;
+    sample_rt_t     rt;
     mq_t            mq;
     msg_t           msg;
-    audio_file_t    file;
-    alsa_pcm_t      alsa;
+    sample_queue_t  queue;
+    sample_event_t* schedule;       // triggers due in a later period, in frame clock
+    int             num_schedule;
+    atomic_uint_fast64_t frame_clock;   // frame position of the next period to render
+    uint64_t        period_ts;      // CLOCK_MONOTONIC estimate of the next period reaching the output
+    uint64_t        late_triggers;
+    sample_output_t output;
+    sample_trig_t** sample;
+    int             num_sample;
+    sample_voice_t* voice;          // pool, active voices packed in [0, num_active)
+    int             max_voice;
+    int             num_active;
+    int             polyphony;
+    sample_steal_t  steal;
+    uint64_t        voice_seq;
+    uint64_t        voice_stolen;
+    int             streaming;      // at least one sample is streamed
+    int             stream_kick;    // a streamed voice consumed frames this period
+    sample_streamer_t streamer;
+    int             shm_enabled;
+    sample_shm_t    shm;            // cross-process trigger ring, drained with the in-process queue
+    uint64_t        shm_rejected;   // shared ring events with an unknown id or invalid flags
+    atomic_uint_fast64_t trig_dropped;  // triggers refused by a full queue, counted by the producers
+    int             stats_enabled;
+    sample_stats_t  stats;          // runtime metrics published once per period
+    int             recording;
+    sample_record_t record;
+    int             replay;
+    atomic_uint_fast64_t replay_limit;  // periods ending at or before this frame may be rendered
+    atomic_int      replay_done;    // replay released and every voice finished, nothing more is rendered
+    const sample_mix_kernel_t* mix;
+    int*            mix_bus;
+    short*          period_buffer;
+    unsigned long   mix_frames;     // capacity of the mix buffers
+    int             realtime;
+    int             direct;         // render into the output buffer through begin/commit
+    int             autotune;
+    int             tune_miss;
+    int             tune_settled;
+    uint64_t        tune_window_ts;
+    uint64_t        tune_stable_ts;
+    uint64_t        xruns;
+    uint64_t        deadline_miss;
+    int             latency_enabled;
+    sample_latency_t latency;
+    uint64_t        voice_frames;
+    uint64_t        start_ts;
+    uint64_t        stop_ts;
 
-} sample_trig_t;
+} sample_engine_t;
 
-int sample_trig_init(sample_trig_t**sample, char** list_sample, int num_sample);
+int sample_trig_init(sample_trig_t**sample, char** list_sample, int num_sample, sample_trig_config_t* config);
 int sample_trig(sample_trig_t** sample_list, sample_id_t id);
+int sample_trig_velocity(sample_trig_t** sample_list, sample_id_t id, uint8_t velocity);
+int sample_trig_batch(sample_trig_t** sample_list, const sample_trig_event_t* events, int count);
+int sample_trig_replay(sample_trig_t** sample_list, sample_replay_t* replay);
+int sample_trig_at(sample_trig_t** sample_list, sample_id_t id, sample_clock_t clock, uint64_t timestamp);
+uint64_t sample_trig_frame_clock(void);
 int sample_trig_exit(sample_trig_t** sample_list, int num_sample);
+int sample_trig_parse_steal(const char* name, sample_steal_t* policy);
+
+#endif /* SAMPLE_TRIG_H */